@@ -1,5 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE /* recvmmsg/sendmmsg */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -24,6 +28,7 @@
 	#include <fcntl.h>
 	#include <pthread.h>
 	#include <arpa/inet.h>
+	#include <sys/mman.h>
 
 	#include <dirent.h>
 
@@ -40,6 +45,7 @@
 	#include <fcntl.h>
 	#include <direct.h>
 	#include <errno.h>
+	#include <io.h>
 #else
 	#error NOT IMPLEMENTED
 #endif
@@ -166,6 +172,29 @@ typedef struct MEMTAIL
 static struct MEMHEADER *first = 0;
 static const int MEM_GUARD_VAL = 0xbaadc0de;
 
+/* the allocation list is shared with the background jobs */
+static volatile long memory_lock = 0;
+
+static void mem_lock()
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	while(InterlockedExchange(&memory_lock, 1))
+		;
+#else
+	while(__sync_lock_test_and_set(&memory_lock, 1))
+		;
+#endif
+}
+
+static void mem_unlock()
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	InterlockedExchange(&memory_lock, 0);
+#else
+	__sync_lock_release(&memory_lock);
+#endif
+}
+
 void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment)
 {
 	/* TODO: fix alignment */
@@ -180,17 +209,19 @@ void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned al
 	header->filename = filename;
 	header->line = line;
 
+	tail->guard = MEM_GUARD_VAL;
+
+	mem_lock();
 	memory_stats.allocated += header->size;
 	memory_stats.total_allocations++;
 	memory_stats.active_allocations++;
 
-	tail->guard = MEM_GUARD_VAL;
-
 	header->prev = (MEMHEADER *)0;
 	header->next = first;
 	if(first)
 		first->prev = header;
 	first = header;
+	mem_unlock();
 
 	/*dbg_msg("mem", "++ %p", header+1); */
 	return header+1;
@@ -206,6 +237,7 @@ void mem_free(void *p)
 		if(tail->guard != MEM_GUARD_VAL)
 			dbg_msg("mem", "!! %p", p);
 		/* dbg_msg("mem", "-- %p", p); */
+		mem_lock();
 		memory_stats.allocated -= header->size;
 		memory_stats.active_allocations--;
 
@@ -215,6 +247,7 @@ void mem_free(void *p)
 			first = header->next;
 		if(header->next)
 			header->next->prev = header->prev;
+		mem_unlock();
 
 		free(header);
 	}
@@ -370,6 +403,68 @@ unsigned io_write_newline(IOHANDLE io)
 #endif
 }
 
+void *io_map(IOHANDLE io, unsigned size)
+{
+	void *data;
+	if(size == 0)
+		return 0;
+#if defined(CONF_FAMILY_UNIX)
+	data = mmap(0, size, PROT_READ, MAP_PRIVATE, fileno((FILE*)io), 0);
+	return data == MAP_FAILED ? 0 : data;
+#elif defined(CONF_FAMILY_WINDOWS)
+	{
+		HANDLE mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno((FILE*)io)), NULL, PAGE_READONLY, 0, 0, NULL);
+		if(!mapping)
+			return 0;
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+		CloseHandle(mapping);
+		return data;
+	}
+#else
+	#error not implemented
+#endif
+}
+
+void io_unmap(void *data, unsigned size)
+{
+	if(!data)
+		return;
+#if defined(CONF_FAMILY_UNIX)
+	munmap(data, size);
+#elif defined(CONF_FAMILY_WINDOWS)
+	UnmapViewOfFile(data);
+#else
+	#error not implemented
+#endif
+}
+
+int io_map_resident(void *data, unsigned size)
+{
+#if defined(CONF_FAMILY_UNIX)
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned num_pages = (size+page_size-1)/page_size;
+	unsigned char *pages;
+	unsigned i;
+	int resident = 0;
+
+	if(!data || !size)
+		return 0;
+	pages = (unsigned char *)mem_alloc(num_pages, 1);
+	if(mincore(data, size, (void *)pages) != 0)
+	{
+		mem_free(pages);
+		return -1;
+	}
+	for(i = 0; i < num_pages; i++)
+		if(pages[i]&1)
+			resident += page_size;
+	mem_free(pages);
+	return resident;
+#else
+	return -1;
+#endif
+}
+
 int io_close(IOHANDLE io)
 {
 	fclose((FILE*)io);
@@ -438,6 +533,17 @@ void thread_sleep(int milliseconds)
 #endif
 }
 
+void thread_sleep_us(int microseconds)
+{
+#if defined(CONF_FAMILY_UNIX)
+	usleep(microseconds);
+#elif defined(CONF_FAMILY_WINDOWS)
+	Sleep(microseconds/1000);
+#else
+	#error not implemented
+#endif
+}
+
 void thread_detach(void *thread)
 {
 #if defined(CONF_FAMILY_UNIX)
@@ -1040,6 +1146,102 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 	return d;
 }
 
+#if defined(CONF_PLATFORM_LINUX)
+static int priv_net_send_batch(int fd, struct mmsghdr *msgs, int num, int *calls)
+{
+	int sent = 0;
+	int i;
+
+	while(sent < num)
+	{
+		int result = sendmmsg(fd, msgs+sent, num-sent, 0);
+		(*calls)++;
+		if(result <= 0)
+			break;
+		sent += result;
+	}
+
+	for(i = 0; i < sent; i++)
+		network_stats.sent_bytes += msgs[i].msg_len;
+	network_stats.sent_packets += sent;
+	return sent;
+}
+#endif
+
+int net_udp_send_batch(NETSOCKET sock, const NETADDR *addrs, const unsigned char *data, const int *sizes, int stride, int num, int *syscalls)
+{
+	int sent = 0;
+	int calls = 0;
+	int i;
+#if defined(CONF_PLATFORM_LINUX)
+	struct mmsghdr msgs4[64];
+	struct mmsghdr msgs6[64];
+	struct iovec iovecs[64];
+	struct sockaddr_storage sockaddrs[64];
+	int base;
+
+	for(base = 0; base < num; base += 64)
+	{
+		int count = num-base < 64 ? num-base : 64;
+		int num4 = 0;
+		int num6 = 0;
+
+		for(i = 0; i < count; i++)
+		{
+			const NETADDR *addr = &addrs[base+i];
+			struct mmsghdr *msg;
+
+			if(addr->type&NETTYPE_LINK_BROADCAST)
+			{
+				calls++;
+				if(net_udp_send(sock, addr, data+(base+i)*stride, sizes[base+i]) >= 0)
+					sent++;
+				continue;
+			}
+
+			if((addr->type&NETTYPE_IPV4) && sock.ipv4sock >= 0)
+			{
+				msg = &msgs4[num4++];
+				mem_zero(msg, sizeof(*msg));
+				netaddr_to_sockaddr_in(addr, (struct sockaddr_in *)&sockaddrs[i]);
+				msg->msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			}
+			else if((addr->type&NETTYPE_IPV6) && sock.ipv6sock >= 0)
+			{
+				msg = &msgs6[num6++];
+				mem_zero(msg, sizeof(*msg));
+				netaddr_to_sockaddr_in6(addr, (struct sockaddr_in6 *)&sockaddrs[i]);
+				msg->msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+			}
+			else
+				continue;
+
+			iovecs[i].iov_base = (void *)(data+(base+i)*stride);
+			iovecs[i].iov_len = sizes[base+i];
+			msg->msg_hdr.msg_name = &sockaddrs[i];
+			msg->msg_hdr.msg_iov = &iovecs[i];
+			msg->msg_hdr.msg_iovlen = 1;
+		}
+
+		if(num4)
+			sent += priv_net_send_batch(sock.ipv4sock, msgs4, num4, &calls);
+		if(num6)
+			sent += priv_net_send_batch(sock.ipv6sock, msgs6, num6, &calls);
+	}
+#else
+	for(i = 0; i < num; i++)
+	{
+		calls++;
+		if(net_udp_send(sock, &addrs[i], data+i*stride, sizes[i]) >= 0)
+			sent++;
+	}
+#endif
+
+	if(syscalls)
+		*syscalls += calls;
+	return sent;
+}
+
 int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 {
 	char sockaddrbuf[128];
@@ -1070,6 +1272,82 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 	return -1; /* error */
 }
 
+#if defined(CONF_PLATFORM_LINUX)
+static int priv_net_recv_batch(int fd, NETADDR *addrs, unsigned char *data, int *sizes, int maxsize, int num)
+{
+	struct mmsghdr msgs[64];
+	struct iovec iovecs[64];
+	struct sockaddr_storage sockaddrs[64];
+	int i, received;
+
+	if(num > 64)
+		num = 64;
+
+	for(i = 0; i < num; i++)
+	{
+		iovecs[i].iov_base = data + i*maxsize;
+		iovecs[i].iov_len = maxsize;
+		mem_zero(&msgs[i], sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_name = &sockaddrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(sockaddrs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	received = recvmmsg(fd, msgs, num, MSG_DONTWAIT, 0);
+	if(received <= 0)
+		return received;
+
+	for(i = 0; i < received; i++)
+	{
+		sockaddr_to_netaddr((struct sockaddr *)&sockaddrs[i], &addrs[i]);
+		sizes[i] = msgs[i].msg_len;
+		network_stats.recv_bytes += msgs[i].msg_len;
+	}
+	network_stats.recv_packets += received;
+	return received;
+}
+#endif
+
+int net_udp_recv_batch(NETSOCKET sock, NETADDR *addrs, unsigned char *data, int *sizes, int maxsize, int num, int *syscalls)
+{
+	int count = 0;
+	int calls = 0;
+#if defined(CONF_PLATFORM_LINUX)
+	int got;
+
+	if(sock.ipv4sock >= 0)
+	{
+		calls++;
+		got = priv_net_recv_batch(sock.ipv4sock, addrs, data, sizes, maxsize, num);
+		if(got > 0)
+			count += got;
+	}
+
+	if(count < num && sock.ipv6sock >= 0)
+	{
+		calls++;
+		got = priv_net_recv_batch(sock.ipv6sock, addrs+count, data+count*maxsize, sizes+count, maxsize, num-count);
+		if(got > 0)
+			count += got;
+	}
+#else
+	while(count < num)
+	{
+		int bytes;
+		calls++;
+		bytes = net_udp_recv(sock, &addrs[count], data+count*maxsize, maxsize);
+		if(bytes <= 0)
+			break;
+		sizes[count++] = bytes;
+	}
+#endif
+
+	if(syscalls)
+		*syscalls += calls;
+	return count;
+}
+
 int net_udp_close(NETSOCKET sock)
 {
 	return priv_net_close_all_sockets(sock);
@@ -1511,13 +1789,18 @@ void swap_endian(void *data, unsigned elem_size, unsigned num)
 }
 
 int net_socket_read_wait(NETSOCKET sock, int time)
+{
+	return net_socket_read_wait_us(sock, 1000*time);
+}
+
+int net_socket_read_wait_us(NETSOCKET sock, int time_us)
 {
 	struct timeval tv;
 	fd_set readfds;
 	int sockid;
 
-	tv.tv_sec = 0;
-	tv.tv_usec = 1000*time;
+	tv.tv_sec = time_us/1000000;
+	tv.tv_usec = time_us%1000000;
 	sockid = 0;
 
 	FD_ZERO(&readfds);
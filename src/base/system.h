@@ -308,6 +308,43 @@ long int io_tell(IOHANDLE io);
 */
 long int io_length(IOHANDLE io);
 
+/*
+	Function: io_map
+		Maps a file read-only into memory.
+
+	Parameters:
+		io - Handle to the file.
+		size - Number of bytes to map from the start of the file.
+
+	Returns:
+		Returns the mapped memory, 0 on failure. The mapping stays
+		valid after the file is closed, until it is unmapped.
+*/
+void *io_map(IOHANDLE io, unsigned size);
+
+/*
+	Function: io_unmap
+		Unmaps memory returned by io_map.
+
+	Parameters:
+		data - The mapped memory.
+		size - The size that was mapped.
+*/
+void io_unmap(void *data, unsigned size);
+
+/*
+	Function: io_map_resident
+		Gets how much of a mapping is in physical memory.
+
+	Parameters:
+		data - The mapped memory.
+		size - The size that was mapped.
+
+	Returns:
+		Returns the resident bytes, -1 if the platform can't tell.
+*/
+int io_map_resident(void *data, unsigned size);
+
 /*
 	Function: io_close
 		Closes a file.
@@ -363,6 +400,16 @@ IOHANDLE io_stderr();
 */
 void thread_sleep(int milliseconds);
 
+/*
+	Function: thread_sleep_us
+		Suspends the current thread for a given period. Windows only
+		sleeps whole milliseconds, the rest is cut off.
+
+	Parameters:
+		microseconds - Number of microseconds to sleep.
+*/
+void thread_sleep_us(int microseconds);
+
 /*
 	Function: teethread_create
 		Creates a new thread.
@@ -601,6 +648,26 @@ NETSOCKET net_udp_create(NETADDR bindaddr);
 */
 int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size);
 
+/*
+	Function: net_udp_send_batch
+		Sends multiple packets over an UDP socket with as few system
+		calls as possible. Uses sendmmsg where available and falls back
+		to one sendto per packet otherwise.
+
+	Parameters:
+		sock - Socket to use.
+		addrs - Array of num addresses to send the packets to.
+		data - Packet data, packet i is stored at data+i*stride.
+		sizes - Array of num packet sizes.
+		stride - Distance in bytes between two packets in data.
+		num - Number of packets to send.
+		syscalls - Optional pointer that gets the number of system calls added.
+
+	Returns:
+		Returns the number of packets that were sent.
+*/
+int net_udp_send_batch(NETSOCKET sock, const NETADDR *addrs, const unsigned char *data, const int *sizes, int stride, int num, int *syscalls);
+
 /*
 	Function: net_udp_recv
 		Recives a packet over an UDP socket.
@@ -617,6 +684,27 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 */
 int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize);
 
+/*
+	Function: net_udp_recv_batch
+		Recives up to num packets over an UDP socket with as few
+		system calls as possible. Uses recvmmsg where available and
+		falls back to one recvfrom per packet otherwise.
+
+	Parameters:
+		sock - Socket to use.
+		addrs - Array of num NETADDRs that will recive the addresses.
+		data - Buffer of num*maxsize bytes, packet i is stored at data+i*maxsize.
+		sizes - Array of num ints that will recive the packet sizes.
+		maxsize - Maximum size to recive per packet.
+		num - Maximum number of packets to recive.
+		syscalls - Optional pointer that gets the number of system calls added.
+
+	Returns:
+		Returns the number of packets recived, 0 if there was nothing
+		to read or an error occured.
+*/
+int net_udp_recv_batch(NETSOCKET sock, NETADDR *addrs, unsigned char *data, int *sizes, int maxsize, int num, int *syscalls);
+
 /*
 	Function: net_udp_close
 		Closes an UDP socket.
@@ -1177,6 +1265,19 @@ int net_would_block();
 
 int net_socket_read_wait(NETSOCKET sock, int time);
 
+/*
+	Function: net_socket_read_wait_us
+		Waits until data can be read from the socket or the time is up.
+
+	Parameters:
+		sock - Socket to wait on.
+		time_us - Maximum time to wait in microseconds.
+
+	Returns:
+		1 if there is data to read, 0 otherwise.
+*/
+int net_socket_read_wait_us(NETSOCKET sock, int time_us);
+
 void mem_debug_dump(IOHANDLE file);
 
 void swap_endian(void *data, unsigned elem_size, unsigned num);
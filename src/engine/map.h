@@ -27,6 +27,17 @@ public:
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual unsigned Crc() = 0;
+	// the file when it is mapped into memory, 0 otherwise
+	virtual const unsigned char *FileData(unsigned *pSize) = 0;
+	virtual void MemoryUsage(int *pResident, int *pAllocated) = 0;
+
+	// the staged map is loaded beside the current one, so it can be
+	// prepared on another thread and swapped in once it is done
+	virtual bool LoadStaged(const char *pMapName) = 0;
+	virtual IEngineMap *Staged() = 0;
+	virtual unsigned StagedCrc() = 0;
+	virtual void SwapStaged() = 0;
+	virtual void UnloadStaged() = 0;
 };
 
 extern IEngineMap *CreateEngineMap();
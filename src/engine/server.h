@@ -5,6 +5,7 @@
 #include <string>
 #include "kernel.h"
 #include "message.h"
+#include <engine/shared/protocol.h>
 
 class IServer : public IInterface
 {
@@ -16,7 +17,7 @@ protected:
 public:
 
 // for spectators to stay spectators after map change
-	std::string m_playerNames[64]; // MAX_CLIENTS
+	std::string m_playerNames[MAX_CLIENTS];
 	int m_numberBots; // number of bots
 	/*
 		Structure: CClientInfo
@@ -59,6 +60,9 @@ public:
 	virtual int SnapNewID() = 0;
 	virtual void SnapFreeID(int ID) = 0;
 	virtual void *SnapNewItem(int Type, int ID, int Size) = 0;
+	virtual int SnapNumItems() = 0;
+	virtual void SnapClearItems() = 0;
+	virtual const void *SnapGetItem(int Index, int *pType, int *pID, int *pSize) = 0;
 
 	virtual void SnapSetStaticsize(int ItemType, int Size) = 0;
 
@@ -84,6 +88,11 @@ public:
 	virtual void OnInit() = 0;
 	virtual void OnConsoleInit() = 0;
 	virtual void OnShutdown() = 0;
+	// runs on a background job with a map that isn't in use yet, loads
+	// what OnInit is going to need. false if the map can't be played
+	virtual bool OnMapPreload(class IMap *pMap) = 0;
+	// frees what OnMapPreload built when that map isn't going to be used
+	virtual void OnMapPreloadDiscard() = 0;
 
 	virtual void OnTick() = 0;
 	virtual void OnPreSnap() = 0;
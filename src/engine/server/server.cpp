@@ -19,11 +19,14 @@
 #include <engine/shared/demo.h>
 #include <engine/shared/econ.h>
 #include <engine/shared/filecollection.h>
+#include <engine/shared/histogram.h>
 #include <engine/shared/netban.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
+#include <engine/shared/profiler.h>
 #include <engine/shared/protocol.h>
 #include <engine/shared/snapshot.h>
+#include <engine/shared/trace.h>
 
 #include "mastersrv.h"
 #include "register.h"
@@ -261,10 +264,13 @@ void CServerBan::ConBanExt(IConsole::IResult *pResult, void *pUser)
 void CServer::CClient::Reset()
 {
 	// reset input
-	for (int i = 0; i < 200; i++)
+	for (int i = 0; i < INPUT_WINDOW; i++)
 		m_aInputs[i].m_GameTick = -1;
-	m_CurrentInput = 0;
 	mem_zero(&m_LatestInput, sizeof(m_LatestInput));
+	m_InputsReceived = 0;
+	m_InputsLate = 0;
+	m_InputsReplaced = 0;
+	m_InputsDropped = 0;
 
 	m_Snapshots.PurgeAll();
 	m_LastAckedSnapshot = -1;
@@ -283,9 +289,14 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_RunServer = 1;
 
 	m_pCurrentMapData = 0;
+	m_pCurrentMapCopy = 0;
 	m_CurrentMapSize = 0;
 
 	m_MapReload = 0;
+	m_MapLoading = false;
+	m_MapLoadJob.m_pServer = this;
+	m_MapLoadJob.m_pData = 0;
+	m_NextTraceDump = 0;
 
 	m_RconClientID = IServer::RCON_CID_SERV;
 	m_RconAuthLevel = AUTHED_ADMIN;
@@ -568,11 +579,19 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 
 void CServer::DoSnapshot()
 {
-	GameServer()->OnPreSnap();
+	CTraceScope TraceScope("snapshot");
+
+	// the game can snap its client independent items here
+	{
+		CProfileScope Scope(CProfiler::SECTION_SNAP_BUILD);
+		m_SnapshotBuilder.Init();
+		GameServer()->OnPreSnap();
+	}
 
 	// create snapshot for demo recording
 	if (m_DemoRecorder.IsRecording())
 	{
+		CProfileScope Scope(CProfiler::SECTION_SNAP_BUILD);
 		char aData[CSnapshot::MAX_SIZE];
 		int SnapshotSize;
 
@@ -585,9 +604,16 @@ void CServer::DoSnapshot()
 		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
 	}
 
-	// create snapshots for all clients
+	// create snapshots for all clients. the delta and compression of each
+	// snapshot run on the job pool while the next snapshot gets built
+	static CSnapshot EmptySnap;
+	EmptySnap.Clear();
+	int NumJobs = 0;
+
 	for (int i = 0; i < MAX_CLIENTS; i++)
 	{
+		m_aSnapJobs[i].m_pTo = 0;
+
 		// client must be ingame to recive snapshots
 		if (m_aClients[i].m_State != CClient::STATE_INGAME)
 			continue;
@@ -603,38 +629,34 @@ void CServer::DoSnapshot()
 		{
 			char aData[CSnapshot::MAX_SIZE];
 			CSnapshot *pData = (CSnapshot *)aData; // Fix compiler warning for strict-aliasing
-			char aDeltaData[CSnapshot::MAX_SIZE];
-			char aCompData[CSnapshot::MAX_SIZE];
+			CSnapJob *pJob = &m_aSnapJobs[i];
 			int SnapshotSize;
-			int Crc;
-			static CSnapshot EmptySnap;
 			CSnapshot *pDeltashot = &EmptySnap;
 			int DeltashotSize;
-			int DeltaTick = -1;
-			int DeltaSize;
 
-			m_SnapshotBuilder.Init();
+			{
+				CProfileScope Scope(CProfiler::SECTION_SNAP_BUILD, i);
+				m_SnapshotBuilder.Init();
 
-			GameServer()->OnSnap(i);
+				GameServer()->OnSnap(i);
 
-			// finish snapshot
-			SnapshotSize = m_SnapshotBuilder.Finish(pData);
-			Crc = pData->Crc();
+				// finish snapshot
+				SnapshotSize = m_SnapshotBuilder.Finish(pData);
 
-			// remove old snapshos
-			// keep 3 seconds worth of snapshots
-			m_aClients[i].m_Snapshots.PurgeUntil(m_CurrentGameTick - SERVER_TICK_SPEED * 3);
+				// remove old snapshos
+				// keep 3 seconds worth of snapshots
+				m_aClients[i].m_Snapshots.PurgeUntil(m_CurrentGameTick - SERVER_TICK_SPEED * 3);
 
-			// save it the snapshot
-			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
+				// save it the snapshot
+				m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
+			}
 
 			// find snapshot that we can preform delta against
-			EmptySnap.Clear();
-
+			pJob->m_DeltaTick = -1;
 			{
 				DeltashotSize = m_aClients[i].m_Snapshots.Get(m_aClients[i].m_LastAckedSnapshot, 0, &pDeltashot, 0);
 				if (DeltashotSize >= 0)
-					DeltaTick = m_aClients[i].m_LastAckedSnapshot;
+					pJob->m_DeltaTick = m_aClients[i].m_LastAckedSnapshot;
 				else
 				{
 					// no acked package found, force client to recover rate
@@ -643,61 +665,122 @@ void CServer::DoSnapshot()
 				}
 			}
 
-			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+			// the stored copy stays valid until the next snapshot purges it
+			m_aClients[i].m_Snapshots.Get(m_CurrentGameTick, 0, &pJob->m_pTo, 0);
+			pJob->m_pFrom = pDeltashot;
+			pJob->m_ClientID = i;
+			pJob->m_pSnapshotDelta = &m_SnapshotDelta;
+
+			if (m_SnapJobPool.NumThreads())
+				m_SnapJobPool.Add(&pJob->m_Job, SnapJobFunc, pJob);
+			else
+				SnapJobFunc(pJob);
+			NumJobs++;
+		}
+	}
+
+	// send the results in client order
+	for (int i = 0; NumJobs && i < MAX_CLIENTS; i++)
+	{
+		CSnapJob *pJob = &m_aSnapJobs[i];
+		if (!pJob->m_pTo)
+			continue;
 
-			if (DeltaSize)
+		// help out instead of just waiting
+		if (m_SnapJobPool.NumThreads())
+		{
+			while (pJob->m_Job.Status() != CJob::STATE_DONE)
 			{
-				// compress it
-				int SnapshotSize;
-				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
-				int NumPackets;
+				if (!m_SnapJobPool.RunJob())
+					thread_yield();
+			}
+		}
+		NumJobs--;
 
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData);
-				NumPackets = (SnapshotSize + MaxSize - 1) / MaxSize;
+		// the jobs time themselves, they may run on another thread
+		if (CProfiler::Enabled())
+		{
+			g_Profiler.Add(CProfiler::SECTION_SNAP_DELTA, pJob->m_DeltaTime);
+			g_Profiler.Add(CProfiler::SECTION_SNAP_COMPRESS, pJob->m_CompressTime);
+		}
 
-				for (int n = 0, Left = SnapshotSize; Left; n++)
-				{
-					int Chunk = Left < MaxSize ? Left : MaxSize;
-					Left -= Chunk;
+		// compare against the original delta implementation
+		if (g_Config.m_DbgSnapDelta)
+		{
+			static char s_aRefData[CSnapshot::MAX_SIZE];
+			int RefSize = m_SnapshotDelta.CreateDeltaReference(pJob->m_pFrom, pJob->m_pTo, s_aRefData);
+			if (RefSize != pJob->m_DeltaSize || mem_comp(s_aRefData, pJob->m_aDeltaData, RefSize) != 0)
+				dbg_msg("snapshot", "delta mismatch. cid=%d tick=%d deltatick=%d size=%d refsize=%d", i, m_CurrentGameTick, pJob->m_DeltaTick, pJob->m_DeltaSize, RefSize);
+		}
 
-					if (NumPackets == 1)
-					{
-						CMsgPacker Msg(NETMSG_SNAPSINGLE);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick - DeltaTick);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n * MaxSize], Chunk);
-						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
-					}
-					else
-					{
-						CMsgPacker Msg(NETMSG_SNAP);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick - DeltaTick);
-						Msg.AddInt(NumPackets);
-						Msg.AddInt(n);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n * MaxSize], Chunk);
-						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
-					}
-				}
-			}
-			else
+		CProfileScope SendScope(CProfiler::SECTION_SNAP_SEND);
+		int DeltaTick = pJob->m_DeltaTick;
+		if (pJob->m_DeltaSize)
+		{
+			const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
+			int SnapshotSize = pJob->m_CompSize;
+			int NumPackets = (SnapshotSize + MaxSize - 1) / MaxSize;
+
+			for (int n = 0, Left = SnapshotSize; Left; n++)
 			{
-				CMsgPacker Msg(NETMSG_SNAPEMPTY);
-				Msg.AddInt(m_CurrentGameTick);
-				Msg.AddInt(m_CurrentGameTick - DeltaTick);
-				SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
+				int Chunk = Left < MaxSize ? Left : MaxSize;
+				Left -= Chunk;
+
+				if (NumPackets == 1)
+				{
+					CMsgPacker Msg(NETMSG_SNAPSINGLE);
+					Msg.AddInt(m_CurrentGameTick);
+					Msg.AddInt(m_CurrentGameTick - DeltaTick);
+					Msg.AddInt(pJob->m_Crc);
+					Msg.AddInt(Chunk);
+					Msg.AddRaw(&pJob->m_aCompData[n * MaxSize], Chunk);
+					SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
+				}
+				else
+				{
+					CMsgPacker Msg(NETMSG_SNAP);
+					Msg.AddInt(m_CurrentGameTick);
+					Msg.AddInt(m_CurrentGameTick - DeltaTick);
+					Msg.AddInt(NumPackets);
+					Msg.AddInt(n);
+					Msg.AddInt(pJob->m_Crc);
+					Msg.AddInt(Chunk);
+					Msg.AddRaw(&pJob->m_aCompData[n * MaxSize], Chunk);
+					SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
+				}
 			}
 		}
+		else
+		{
+			CMsgPacker Msg(NETMSG_SNAPEMPTY);
+			Msg.AddInt(m_CurrentGameTick);
+			Msg.AddInt(m_CurrentGameTick - DeltaTick);
+			SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
+		}
 	}
 
 	GameServer()->OnPostSnap();
 }
 
+int CServer::SnapJobFunc(void *pUser)
+{
+	CSnapJob *pJob = (CSnapJob *)pUser;
+
+	// only reads the snapshots and the static item sizes
+	bool Profile = CProfiler::Enabled() || CTrace::Enabled();
+	int64 Start = Profile ? time_get() : 0;
+	pJob->m_Crc = pJob->m_pTo->Crc();
+	pJob->m_DeltaSize = pJob->m_pSnapshotDelta->CreateDelta(pJob->m_pFrom, pJob->m_pTo, pJob->m_aDeltaData);
+	int64 Delta = Profile ? time_get() : 0;
+	pJob->m_CompSize = pJob->m_DeltaSize ? CVariableInt::Compress(pJob->m_aDeltaData, pJob->m_DeltaSize, pJob->m_aCompData) : 0;
+	int64 End = Profile ? time_get() : 0;
+	pJob->m_DeltaTime = Delta-Start;
+	pJob->m_CompressTime = End-Delta;
+	if (CTrace::Enabled())
+		g_Trace.Add("snap job", Start, End, pJob->m_ClientID, CTrace::THREAD_JOBS);
+	return 0;
+}
+
 int CServer::NewClientCallback(int ClientID, void *pUser)
 {
 	CServer *pThis = (CServer *)pUser;
@@ -806,10 +889,13 @@ void CServer::SendRconCmdRem(const IConsole::CCommandInfo *pCommandInfo, int Cli
 
 void CServer::UpdateClientRconCommands()
 {
-	int ClientID = Tick() % MAX_CLIENTS;
-
-	if (m_aClients[ClientID].m_State != CClient::STATE_EMPTY && m_aClients[ClientID].m_Authed)
+	// every client with pending commands gets some each tick, going round
+	// one slot per tick took seconds with all slots in use
+	for (int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
 	{
+		if (m_aClients[ClientID].m_State == CClient::STATE_EMPTY || !m_aClients[ClientID].m_Authed || !m_aClients[ClientID].m_pRconCmdToSend)
+			continue;
+
 		int ConsoleAccessLevel = m_aClients[ClientID].m_Authed == AUTHED_ADMIN ? IConsole::ACCESS_LEVEL_ADMIN : IConsole::ACCESS_LEVEL_MOD;
 		for (int i = 0; i < MAX_RCONCMD_SEND && m_aClients[ClientID].m_pRconCmdToSend; ++i)
 		{
@@ -970,21 +1056,29 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 			}
 
 			m_aClients[ClientID].m_LastInputTick = IntendedTick;
-
-			pInput = &m_aClients[ClientID].m_aInputs[m_aClients[ClientID].m_CurrentInput];
+			m_aClients[ClientID].m_InputsReceived++;
 
 			if (IntendedTick <= Tick())
+			{
 				IntendedTick = Tick() + 1;
-
-			pInput->m_GameTick = IntendedTick;
+				m_aClients[ClientID].m_InputsLate++;
+			}
 
 			for (int i = 0; i < Size / 4; i++)
-				pInput->m_aData[i] = Unpacker.GetInt();
-
-			mem_copy(m_aClients[ClientID].m_LatestInput.m_aData, pInput->m_aData, MAX_INPUT_SIZE * sizeof(int));
+				m_aClients[ClientID].m_LatestInput.m_aData[i] = Unpacker.GetInt();
 
-			m_aClients[ClientID].m_CurrentInput++;
-			m_aClients[ClientID].m_CurrentInput %= 200;
+			// the slot of the current tick was used already, so the window
+			// reaches up to INPUT_WINDOW ticks ahead
+			if (IntendedTick > Tick() + CClient::INPUT_WINDOW)
+				m_aClients[ClientID].m_InputsDropped++;
+			else
+			{
+				pInput = &m_aClients[ClientID].m_aInputs[IntendedTick % CClient::INPUT_WINDOW];
+				if (pInput->m_GameTick == IntendedTick)
+					m_aClients[ClientID].m_InputsReplaced++;
+				pInput->m_GameTick = IntendedTick;
+				mem_copy(pInput->m_aData, m_aClients[ClientID].m_LatestInput.m_aData, MAX_INPUT_SIZE * sizeof(int));
+			}
 
 			// call the mod with the fresh input data
 			if (m_aClients[ClientID].m_State == CClient::STATE_INGAME)
@@ -1214,18 +1308,23 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 	// flags
 	ADD_INT(p, g_Config.m_Password[0] ? SERVER_FLAG_PASSWORD : 0);
 
+	// older browsers can't list more clients than they have ids for
 	int MaxClients = m_NetServer.MaxClients();
+	int MaxListed = MAX_CLIENTS;
 	if(Type == SERVERINFO_VANILLA || Type == SERVERINFO_INGAME)
+		MaxListed = VANILLA_MAX_CLIENTS;
+	else if(Type == SERVERINFO_64_LEGACY)
+		MaxListed = LEGACY_MAX_CLIENTS;
+	if(MaxClients > MaxListed)
 	{
-		if(ClientCount >= VANILLA_MAX_CLIENTS)
+		if(ClientCount >= MaxListed)
 		{
 			if(ClientCount < MaxClients)
-				ClientCount = VANILLA_MAX_CLIENTS - 1;
+				ClientCount = MaxListed - 1;
 			else
-				ClientCount = VANILLA_MAX_CLIENTS;
+				ClientCount = MaxListed;
 		}
-		if(MaxClients > VANILLA_MAX_CLIENTS)
-			MaxClients = VANILLA_MAX_CLIENTS;
+		MaxClients = MaxListed;
 		if(PlayerCount > ClientCount)
 			PlayerCount = ClientCount;
 	}
@@ -1372,6 +1471,7 @@ void CServer::UpdateServerInfo()
 
 void CServer::PumpNetwork()
 {
+	CProfileScope Scope(CProfiler::SECTION_NETWORK);
 	CNetChunk Packet;
 
 	m_NetServer.Update();
@@ -1473,23 +1573,76 @@ char *CServer::GetMapName()
 
 int CServer::LoadMap(const char *pMapName)
 {
-	// DATAFILE *df;
-	char aBuf[512];
-	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	// the first map is loaded right away, there is nothing to keep running
+	str_copy(m_MapLoadJob.m_aMapName, pMapName, sizeof(m_MapLoadJob.m_aMapName));
+	MapLoadJobFunc(&m_MapLoadJob);
+	if (!m_MapLoadJob.m_Loaded)
+		return 0;
+
+	SwapMap();
+	return 1;
+}
 
-	/*df = datafile_load(buf);
-	if(!df)
-		return 0;*/
+int CServer::MapLoadJobFunc(void *pUser)
+{
+	CMapLoadJob *pJob = (CMapLoadJob *)pUser;
+	CServer *pThis = pJob->m_pServer;
+	int64 StartTime = time_get();
+	pJob->m_Loaded = false;
 
-	// check for valid standard map
-	/*if (!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
-	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
+	// only the staged map is touched here, the game runs on the current one
+	char aBuf[512];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pJob->m_aMapName);
+	if (!pThis->m_pMap->LoadStaged(aBuf))
 		return 0;
-	}*/
+	pJob->m_Crc = pThis->m_pMap->StagedCrc();
 
-	if (!m_pMap->Load(aBuf))
+	if (!pThis->GameServer()->OnMapPreload(pThis->m_pMap->Staged()))
+	{
+		pThis->m_pMap->UnloadStaged();
 		return 0;
+	}
+
+	// the downloads are served from the mapping, otherwise from a copy of the file
+	unsigned MappedSize;
+	if (!pThis->m_pMap->Staged()->FileData(&MappedSize))
+	{
+		IOHANDLE File = pThis->Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
+		if (!File)
+		{
+			pThis->m_pMap->UnloadStaged();
+			return 0;
+		}
+		pJob->m_DataSize = (int)io_length(File);
+		pJob->m_pData = (unsigned char *)mem_alloc(pJob->m_DataSize, 1);
+		io_read(File, pJob->m_pData, pJob->m_DataSize);
+		io_close(File);
+	}
+
+	pJob->m_LoadTime = time_get() - StartTime;
+	pJob->m_Loaded = true;
+	return 0;
+}
+
+void CServer::StartMapLoad(const char *pMapName)
+{
+	str_copy(m_MapLoadJob.m_aMapName, pMapName, sizeof(m_MapLoadJob.m_aMapName));
+	m_MapLoading = true;
+	m_MapJobPool.Add(&m_MapLoadJob.m_Job, MapLoadJobFunc, &m_MapLoadJob);
+}
+
+void CServer::DiscardMapLoad()
+{
+	GameServer()->OnMapPreloadDiscard();
+	m_pMap->UnloadStaged();
+	if (m_MapLoadJob.m_pData)
+		mem_free(m_MapLoadJob.m_pData);
+	m_MapLoadJob.m_pData = 0;
+}
+
+void CServer::SwapMap()
+{
+	m_pMap->SwapStaged();
 
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
@@ -1497,26 +1650,31 @@ int CServer::LoadMap(const char *pMapName)
 	// reinit snapshot ids
 	m_IDPool.TimeoutIDs();
 
-	// get the crc of the map
-	m_CurrentMapCrc = m_pMap->Crc();
-	char aBufMsg[256];
-	str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, m_CurrentMapCrc);
-	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
+	m_CurrentMapCrc = m_MapLoadJob.m_Crc;
+	str_copy(m_aCurrentMap, m_MapLoadJob.m_aMapName, sizeof(m_aCurrentMap));
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map crc is %08x, loaded in %dms", m_aCurrentMap, m_CurrentMapCrc,
+		(int)(m_MapLoadJob.m_LoadTime*1000/time_freq()));
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 
-	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
-	// map_set(df);
+	if (m_pCurrentMapCopy)
+		mem_free(m_pCurrentMapCopy);
+	m_pCurrentMapCopy = m_MapLoadJob.m_pData;
+	m_MapLoadJob.m_pData = 0;
 
-	// load complete map into memory for download
+	unsigned MappedSize;
+	const unsigned char *pMapped = m_pMap->FileData(&MappedSize);
+	if (pMapped)
 	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		m_CurrentMapSize = (int)io_length(File);
-		if (m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
-		io_close(File);
+		m_pCurrentMapData = pMapped;
+		m_CurrentMapSize = MappedSize;
+	}
+	else
+	{
+		m_pCurrentMapData = m_pCurrentMapCopy;
+		m_CurrentMapSize = m_MapLoadJob.m_DataSize;
 	}
-	return 1;
 }
 
 void CServer::InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole)
@@ -1572,10 +1730,20 @@ int CServer::Run()
 	// process pending commands
 	m_pConsole->StoreCommands(false);
 
+	if(g_Config.m_SvSnapThreads)
+		m_SnapJobPool.Init(g_Config.m_SvSnapThreads);
+	m_MapJobPool.Init(1);
+
+	if(g_Config.m_SvNetThread && !m_NetServer.StartThread())
+		dbg_msg("server", "couldn't start network thread, running without it");
+
 	// start game
 	{
 		int64 ReportTime = time_get();
 		int ReportInterval = 3;
+		CNetStats ReportStats;
+		mem_zero(&ReportStats, sizeof(ReportStats));
+		int ReportTick = 0;
 
 		m_Lastheartbeat = 0;
 		m_GameStartTime = time_get();
@@ -1591,16 +1759,35 @@ int CServer::Run()
 			int64 t = time_get();
 			int NewTicks = 0;
 
-			// load new map TODO: don't poll this
-			if (str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload)
+			// load the new map in the background, the old one keeps running until then
+			if ((str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload) && !m_MapLoading)
 			{
 				m_MapReload = 0;
+				StartMapLoad(g_Config.m_SvMap);
+			}
+
+			// swap it in between two ticks
+			if (m_MapLoading && m_MapLoadJob.m_Job.Status() == CJob::STATE_DONE)
+			{
+				m_MapLoading = false;
 
-				// load map
-				if (LoadMap(g_Config.m_SvMap))
+				if (!m_MapLoadJob.m_Loaded)
 				{
-					// new map loaded
+					str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", m_MapLoadJob.m_aMapName);
+					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+					if (str_comp(g_Config.m_SvMap, m_MapLoadJob.m_aMapName) == 0)
+						str_copy(g_Config.m_SvMap, m_aCurrentMap, sizeof(g_Config.m_SvMap));
+				}
+				else if (str_comp(g_Config.m_SvMap, m_MapLoadJob.m_aMapName) != 0)
+				{
+					// sv_map changed while loading, the next iteration loads that one
+					DiscardMapLoad();
+				}
+				else
+				{
+					CTraceScope TraceScope("map swap");
 					GameServer()->OnShutdown();
+					SwapMap();
 
 					for (int c = 0; c < MAX_CLIENTS; c++)
 					{
@@ -1618,35 +1805,28 @@ int CServer::Run()
 					GameServer()->OnInit();
 					UpdateServerInfo();
 				}
-				else
-				{
-					str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", g_Config.m_SvMap);
-					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-					str_copy(g_Config.m_SvMap, m_aCurrentMap, sizeof(g_Config.m_SvMap));
-				}
 			}
 
 			while (t > TickStartTime(m_CurrentGameTick + 1))
 			{
 				m_CurrentGameTick++;
 				NewTicks++;
+				m_TickLateness.Add((int)((t-TickStartTime(m_CurrentGameTick))*1000000/time_freq()));
 
 				// apply new input
-				for (int c = 0; c < MAX_CLIENTS; c++)
 				{
-					if (m_aClients[c].m_State == CClient::STATE_EMPTY)
-						continue;
-					for (int i = 0; i < 200; i++)
+					CProfileScope Scope(CProfiler::SECTION_INPUT);
+					for (int c = 0; c < MAX_CLIENTS; c++)
 					{
-						if (m_aClients[c].m_aInputs[i].m_GameTick == Tick())
-						{
-							if (m_aClients[c].m_State == CClient::STATE_INGAME)
-								GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);
-							break;
-						}
+						if (m_aClients[c].m_State != CClient::STATE_INGAME)
+							continue;
+						CClient::CInput *pInput = &m_aClients[c].m_aInputs[Tick() % CClient::INPUT_WINDOW];
+						if (pInput->m_GameTick == Tick())
+							GameServer()->OnClientPredictedInput(c, pInput->m_aData);
 					}
 				}
 
+				CTraceScope TraceScope("game tick");
 				GameServer()->OnTick();
 			}
 
@@ -1664,35 +1844,78 @@ int CServer::Run()
 
 			PumpNetwork();
 
-			if (ReportTime < time_get())
-			{
-				if (g_Config.m_Debug)
-				{
-					/*
-					static NETSTATS prev_stats;
-					NETSTATS stats;
-					netserver_stats(net, &stats);
-
-					perf_next();
+			// hand everything queued during this iteration to the kernel
+			m_NetServer.FlushSendQueue();
 
-					if(config.dbg_pref)
-						perf_dump(&rootscope);
-
-					dbg_msg("server", "send=%8d recv=%8d",
-						(stats.send_bytes - prev_stats.send_bytes)/reportinterval,
-						(stats.recv_bytes - prev_stats.recv_bytes)/reportinterval);
+			if (NewTicks)
+			{
+				g_Profiler.EndTick();
 
-					prev_stats = stats;
-					*/
+				// keep the slow ticks for a look in a trace viewer
+				if (CTrace::Enabled())
+				{
+					int64 TickEnd = time_get();
+					g_Trace.Add("tick", t, TickEnd);
+					if (g_Config.m_DbgTraceBudget && (TickEnd - t) * 1000000 / time_freq() > g_Config.m_DbgTraceBudget && TickEnd > m_NextTraceDump)
+					{
+						str_format(aBuf, sizeof(aBuf), "tick %d took %dus", m_CurrentGameTick, (int)((TickEnd - t) * 1000000 / time_freq()));
+						Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", aBuf);
+						DumpTrace();
+						m_NextTraceDump = TickEnd + time_freq() * 10;
+					}
 				}
+			}
 
+			// the network counters come back from the network thread a
+			// little later, they are reported once they are there
+			if (ReportTime < time_get())
+			{
+				m_NetServer.RequestStats();
 				ReportTime += time_freq() * ReportInterval;
 			}
 
-			// wait for incomming data
-			net_socket_read_wait(m_NetServer.Socket(), 5);
+			CNetStats Stats;
+			if (m_NetServer.PollStats(&Stats))
+			{
+				if (g_Config.m_Debug)
+				{
+					int64 RecvPackets = Stats.m_RecvPackets - ReportStats.m_RecvPackets;
+					int64 RecvSyscalls = Stats.m_RecvSyscalls - ReportStats.m_RecvSyscalls;
+					str_format(aBuf, sizeof(aBuf), "recv packets=%d syscalls=%d packets/syscall=%.2f",
+						(int)(RecvPackets/ReportInterval), (int)(RecvSyscalls/ReportInterval),
+						RecvSyscalls ? RecvPackets/(float)RecvSyscalls : 0.0f);
+					Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+
+					int Ticks = max(m_CurrentGameTick - ReportTick, 1);
+					int64 SendFlushes = Stats.m_SendFlushes - ReportStats.m_SendFlushes;
+					str_format(aBuf, sizeof(aBuf), "send packets/tick=%.2f syscalls/tick=%.2f flush avg=%dus max=%dus",
+						(Stats.m_SendPackets - ReportStats.m_SendPackets)/(float)Ticks,
+						(Stats.m_SendSyscalls - ReportStats.m_SendSyscalls)/(float)Ticks,
+						SendFlushes ? (int)((Stats.m_SendFlushTime - ReportStats.m_SendFlushTime)*1000000/SendFlushes/time_freq()) : 0,
+						(int)(Stats.m_SendMaxFlushTime*1000000/time_freq()));
+					Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+				}
+				ReportStats = Stats;
+				ReportTick = m_CurrentGameTick;
+			}
+
+			// sleep until shortly before the next tick or until data comes in,
+			// the rest is busy waited as the sleep can overshoot
+			int64 Deadline = TickStartTime(m_CurrentGameTick + 1);
+			int64 Margin = g_Config.m_SvTickSpinMargin*time_freq()/1000000;
+			int64 Now = time_get();
+			if(Deadline - Now > Margin)
+				m_NetServer.Wait((int)((Deadline - Now - Margin)*1000000/time_freq()));
+			else
+			{
+				while(Now < Deadline)
+					Now = time_get();
+			}
 		}
 	}
+	// the remaining traffic is sent from this thread
+	m_NetServer.StopThread();
+
 	// disconnect all clients on shutdown
 	for (int i = 0; i < MAX_CLIENTS; ++i)
 	{
@@ -1701,12 +1924,18 @@ int CServer::Run()
 
 		m_Econ.Shutdown();
 	}
+	m_NetServer.FlushSendQueue();
+
+	// a map still loading must be done with the map before it goes away
+	while (m_MapLoading && m_MapLoadJob.m_Job.Status() != CJob::STATE_DONE)
+		thread_sleep(1);
+	DiscardMapLoad();
 
 	GameServer()->OnShutdown();
 	m_pMap->Unload();
 
-	if (m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
+	if (m_pCurrentMapCopy)
+		mem_free(m_pCurrentMapCopy);
 	return 0;
 }
 
@@ -1747,6 +1976,119 @@ void CServer::ConStatus(IConsole::IResult *pResult, void *pUser)
 	}
 }
 
+void CServer::ConSnapMemory(IConsole::IResult *pResult, void *pUser)
+{
+	char aBuf[256];
+	CServer *pThis = static_cast<CServer *>(pUser);
+	int TotalUsed = 0;
+	int TotalAllocated = 0;
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CSnapshotStorage *pStorage = &pThis->m_aClients[i].m_Snapshots;
+		TotalUsed += pStorage->MemoryUsed();
+		TotalAllocated += pStorage->MemoryAllocated();
+		if(pThis->m_aClients[i].m_State == CClient::STATE_EMPTY && !pStorage->MemoryAllocated())
+			continue;
+
+		str_format(aBuf, sizeof(aBuf), "id=%d snapshots=%d used=%dkb allocated=%dkb", i,
+			pStorage->NumSnapshots(), pStorage->MemoryUsed()/1024, pStorage->MemoryAllocated()/1024);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	}
+
+	str_format(aBuf, sizeof(aBuf), "total used=%dkb allocated=%dkb", TotalUsed/1024, TotalAllocated/1024);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+}
+
+void CServer::ConInputStats(IConsole::IResult *pResult, void *pUser)
+{
+	char aBuf[256];
+	CServer *pThis = static_cast<CServer *>(pUser);
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CClient *pClient = &pThis->m_aClients[i];
+		if(pClient->m_State == CClient::STATE_EMPTY)
+			continue;
+
+		str_format(aBuf, sizeof(aBuf), "id=%d received=%d late=%d replaced=%d dropped=%d", i,
+			pClient->m_InputsReceived, pClient->m_InputsLate, pClient->m_InputsReplaced, pClient->m_InputsDropped);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	}
+}
+
+void CServer::ConTickLateness(IConsole::IResult *pResult, void *pUser)
+{
+	char aBuf[256];
+	CServer *pThis = static_cast<CServer *>(pUser);
+	CHistogram *pLateness = &pThis->m_TickLateness;
+
+	str_format(aBuf, sizeof(aBuf), "ticks=%d p50=%dus p99=%dus max=%dus", pLateness->Num(),
+		pLateness->Percentile(50), pLateness->Percentile(99), pLateness->Max());
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	pLateness->Reset();
+}
+
+void CServer::DumpTrace()
+{
+	char aBuf[256];
+	char aDate[20];
+	char aFilename[128];
+	str_timestamp(aDate, sizeof(aDate));
+	str_format(aFilename, sizeof(aFilename), "dumps/trace_%s.json", aDate);
+
+	Storage()->CreateFolder("dumps", IStorage::TYPE_SAVE);
+	IOHANDLE File = Storage()->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if (!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to open %s", aFilename);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", aBuf);
+		return;
+	}
+
+	int NumEvents = g_Trace.Write(File);
+	io_close(File);
+
+	str_format(aBuf, sizeof(aBuf), "wrote %d events to %s", NumEvents, aFilename);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", aBuf);
+}
+
+void CServer::ConTraceDump(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if (!CTrace::Enabled())
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", "the trace is off, enable it with dbg_trace 1");
+	pThis->DumpTrace();
+}
+
+void CServer::ConMapMemory(IConsole::IResult *pResult, void *pUser)
+{
+	char aBuf[256];
+	CServer *pThis = static_cast<CServer *>(pUser);
+
+	int Resident, Allocated;
+	pThis->m_pMap->MemoryUsage(&Resident, &Allocated);
+	str_format(aBuf, sizeof(aBuf), "map=%s file=%dkb mapped=%s resident=%dkb allocated=%dkb download_copy=%dkb", pThis->m_aCurrentMap,
+		pThis->m_CurrentMapSize/1024, pThis->m_pCurrentMapCopy ? "no" : "yes", Resident/1024, Allocated/1024,
+		pThis->m_pCurrentMapCopy ? pThis->m_CurrentMapSize/1024 : 0);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+
+	if (pThis->m_MapLoading)
+	{
+		str_format(aBuf, sizeof(aBuf), "loading map=%s", pThis->m_MapLoadJob.m_aMapName);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	}
+}
+
+void CServer::ConPerf(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if(!CProfiler::Enabled())
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", "the profiler is off, enable it with dbg_pref 1");
+	g_Profiler.Report(pThis->Console());
+	g_Profiler.Reset();
+}
+
 void CServer::ConShutdown(IConsole::IResult *pResult, void *pUser)
 {
 	if (pResult->NumArguments() > 0) {
@@ -1911,6 +2253,12 @@ void CServer::RegisterCommands()
 	// register console commands
 	Console()->Register("kick", "i?r", CFGFLAG_SERVER, ConKick, this, "Kick player with specified id for any reason");
 	Console()->Register("status", "", CFGFLAG_SERVER, ConStatus, this, "List players");
+	Console()->Register("snap_memory", "", CFGFLAG_SERVER, ConSnapMemory, this, "Show the snapshot storage memory per client");
+	Console()->Register("trace_dump", "", CFGFLAG_SERVER, ConTraceDump, this, "Write the recorded tick phases to dumps/ as a Chrome trace (needs dbg_trace 1)");
+	Console()->Register("map_memory", "", CFGFLAG_SERVER, ConMapMemory, this, "Show the memory used by the current map");
+	Console()->Register("perf", "", CFGFLAG_SERVER, ConPerf, this, "Show the time spent in each tick phase since the last call (needs dbg_pref 1)");
+	Console()->Register("tick_lateness", "", CFGFLAG_SERVER, ConTickLateness, this, "Show how late the ticks started since the last call");
+	Console()->Register("input_stats", "", CFGFLAG_SERVER, ConInputStats, this, "Show the late, replaced and dropped inputs per client");
 	Console()->Register("shutdown", "?r", CFGFLAG_SERVER, ConShutdown, this, "Shut down");
 	Console()->Register("logout", "", CFGFLAG_SERVER, ConLogout, this, "Logout of rcon");
 
@@ -1949,6 +2297,25 @@ void *CServer::SnapNewItem(int Type, int ID, int Size)
 	return ID < 0 ? 0 : m_SnapshotBuilder.NewItem(Type, ID, Size);
 }
 
+int CServer::SnapNumItems()
+{
+	return m_SnapshotBuilder.NumItems();
+}
+
+void CServer::SnapClearItems()
+{
+	m_SnapshotBuilder.Init();
+}
+
+const void *CServer::SnapGetItem(int Index, int *pType, int *pID, int *pSize)
+{
+	CSnapshotItem *pItem = m_SnapshotBuilder.GetItem(Index);
+	*pType = pItem->Type();
+	*pID = pItem->ID();
+	*pSize = m_SnapshotBuilder.GetItemSize(Index);
+	return pItem->Data();
+}
+
 void CServer::SnapSetStaticsize(int ItemType, int Size)
 {
 	m_SnapshotDelta.SetStaticsize(ItemType, Size);
@@ -97,6 +97,12 @@ public:
 			SNAPRATE_RECOVER
 		};
 
+		enum
+		{
+			// inputs are kept for the ticks up to this far ahead
+			INPUT_WINDOW=64,
+		};
+
 		class CInput
 		{
 		public:
@@ -113,9 +119,13 @@ public:
 		int m_LastInputTick;
 		CSnapshotStorage m_Snapshots;
 
+		// the inputs by the tick they are for, modulo INPUT_WINDOW
 		CInput m_LatestInput;
-		CInput m_aInputs[200]; // TODO: handle input better
-		int m_CurrentInput;
+		CInput m_aInputs[INPUT_WINDOW];
+		int m_InputsReceived;
+		int m_InputsLate; // arrived after their tick, used for the next one
+		int m_InputsReplaced; // a later input for the same tick came in
+		int m_InputsDropped; // too far ahead for the window
 
 		char m_aName[MAX_NAME_LENGTH];
 		char m_aClan[MAX_CLAN_LENGTH];
@@ -132,6 +142,48 @@ public:
 
 	CClient m_aClients[MAX_CLIENTS];
 
+	// delta and compression of one client snapshot, independent of the others
+	class CSnapJob
+	{
+	public:
+		CJob m_Job;
+		CSnapshotDelta *m_pSnapshotDelta;
+		CSnapshot *m_pFrom;
+		CSnapshot *m_pTo;
+		int m_DeltaTick;
+
+		int m_Crc;
+		int m_DeltaSize;
+		int m_CompSize;
+		int m_ClientID;
+		int64 m_DeltaTime;
+		int64 m_CompressTime;
+		char m_aDeltaData[CSnapshot::MAX_SIZE];
+		char m_aCompData[CSnapshot::MAX_SIZE];
+	};
+
+	CSnapJob m_aSnapJobs[MAX_CLIENTS];
+	CJobPool m_SnapJobPool;
+
+	// loads the next map on its own thread while the current one runs on
+	class CMapLoadJob
+	{
+	public:
+		CJob m_Job;
+		class CServer *m_pServer;
+		char m_aMapName[64];
+
+		bool m_Loaded;
+		unsigned m_Crc;
+		unsigned char *m_pData;
+		int m_DataSize;
+		int64 m_LoadTime;
+	};
+
+	CMapLoadJob m_MapLoadJob;
+	CJobPool m_MapJobPool;
+	bool m_MapLoading;
+
 	CSnapshotDelta m_SnapshotDelta;
 	CSnapshotBuilder m_SnapshotBuilder;
 	CSnapIDPool m_IDPool;
@@ -142,6 +194,8 @@ public:
 	IEngineMap *m_pMap;
 
 	int64 m_GameStartTime;
+	CHistogram m_TickLateness;
+	int64 m_NextTraceDump;
 	//int m_CurrentGameTick;
 	int m_RunServer;
 	int m_MapReload;
@@ -154,7 +208,8 @@ public:
 
 	char m_aCurrentMap[64];
 	unsigned m_CurrentMapCrc;
-	unsigned char *m_pCurrentMapData;
+	const unsigned char *m_pCurrentMapData;
+	unsigned char *m_pCurrentMapCopy; // when the map file isn't mapped
 	int m_CurrentMapSize;
 
 	bool m_ServerInfoHighLoad;
@@ -199,6 +254,7 @@ public:
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID);
 	int SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System);
 
+	static int SnapJobFunc(void *pUser);
 	void DoSnapshot();
 
 	static int NewClientCallback(int ClientID, void *pUser);
@@ -223,12 +279,23 @@ public:
 
 	char *GetMapName();
 	int LoadMap(const char *pMapName);
+	static int MapLoadJobFunc(void *pUser);
+	void StartMapLoad(const char *pMapName);
+	void DiscardMapLoad();
+	void SwapMap();
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole);
 	int Run();
+	void DumpTrace();
 
 	static void ConKick(IConsole::IResult *pResult, void *pUser);
 	static void ConStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConSnapMemory(IConsole::IResult *pResult, void *pUser);
+	static void ConInputStats(IConsole::IResult *pResult, void *pUser);
+	static void ConTickLateness(IConsole::IResult *pResult, void *pUser);
+	static void ConMapMemory(IConsole::IResult *pResult, void *pUser);
+	static void ConPerf(IConsole::IResult *pResult, void *pUser);
+	static void ConTraceDump(IConsole::IResult *pResult, void *pUser);
 	static void ConShutdown(IConsole::IResult *pResult, void *pUser);
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
@@ -247,6 +314,9 @@ public:
 	virtual int SnapNewID();
 	virtual void SnapFreeID(int ID);
 	virtual void *SnapNewItem(int Type, int ID, int Size);
+	virtual int SnapNumItems();
+	virtual void SnapClearItems();
+	virtual const void *SnapGetItem(int Index, int *pType, int *pID, int *pSize);
 	void SnapSetStaticsize(int ItemType, int Size);
 };
 
@@ -18,6 +18,12 @@ MACRO_CONFIG_STR(SvMap, sv_map, 128, "dm1", CFGFLAG_SERVER, "Map to use on the s
 MACRO_CONFIG_INT(SvMaxClients, sv_max_clients, 32, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients that are allowed on a server")
 MACRO_CONFIG_INT(SvMaxClientsPerIP, sv_max_clients_per_ip, 2, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients with the same IP that can connect to the server")
 MACRO_CONFIG_INT(SvHighBandwidth, sv_high_bandwidth, 0, 0, 1, CFGFLAG_SERVER, "Use high bandwidth mode. Doubles the bandwidth required for the server. LAN use only")
+MACRO_CONFIG_INT(SvNetRecvBatch, sv_net_recv_batch, 32, 0, 64, CFGFLAG_SERVER, "Maximum number of packets received per system call (0 or 1 = one packet per call)")
+MACRO_CONFIG_INT(SvNetSendBatch, sv_net_send_batch, 1, 0, 1, CFGFLAG_SERVER, "Queue outgoing packets and send them in batches once per server loop iteration")
+MACRO_CONFIG_INT(SvNetThread, sv_net_thread, 0, 0, 1, CFGFLAG_SERVER, "Run packet receiving, acks and send flushing on a separate network thread (needs restart)")
+MACRO_CONFIG_INT(SvSnapShared, sv_snap_shared, 1, 0, 1, CFGFLAG_SERVER, "Snap the world once per snapshot and derive the client snapshots from it")
+MACRO_CONFIG_INT(SvSnapThreads, sv_snap_threads, 0, 0, 16, CFGFLAG_SERVER, "Number of worker threads for snapshot delta and compression, 0 for none (needs restart)")
+MACRO_CONFIG_INT(SvTickSpinMargin, sv_tick_spin_margin, 200, 0, 5000, CFGFLAG_SERVER, "Microseconds before a tick that are busy waited instead of slept")
 MACRO_CONFIG_INT(SvServerInfoPerSecond, sv_server_info_per_second, 10, 1, 1000, CFGFLAG_SERVER, "Maximum number of complete server info responses that are sent out per second")
 MACRO_CONFIG_INT(SvRegister, sv_register, 1, 0, 1, CFGFLAG_SERVER, "Register server with master server for public listing")
 MACRO_CONFIG_STR(SvRconPassword, sv_rcon_password, 32, "", CFGFLAG_SERVER, "Remote console password (full access)")
@@ -37,8 +43,11 @@ MACRO_CONFIG_INT(EcOutputLevel, ec_output_level, 1, 0, 2, CFGFLAG_ECON, "Adjusts
 MACRO_CONFIG_INT(Debug, debug, 0, 0, 1, CFGFLAG_SERVER, "Debug mode")
 MACRO_CONFIG_INT(DbgStress, dbg_stress, 0, 0, 0, CFGFLAG_SERVER, "Stress systems")
 MACRO_CONFIG_INT(DbgStressNetwork, dbg_stress_network, 0, 0, 0, CFGFLAG_SERVER, "Stress network")
-MACRO_CONFIG_INT(DbgPref, dbg_pref, 0, 0, 1, CFGFLAG_SERVER, "Performance outputs")
+MACRO_CONFIG_INT(DbgPref, dbg_pref, 0, 0, 1, CFGFLAG_SERVER, "Time the phases of each tick, see the perf command")
+MACRO_CONFIG_INT(DbgTrace, dbg_trace, 0, 0, 1, CFGFLAG_SERVER, "Record the tick phases for trace_dump")
+MACRO_CONFIG_INT(DbgTraceBudget, dbg_trace_budget, 0, 0, 1000000, CFGFLAG_SERVER, "Dump the trace when a tick takes longer than this many microseconds (0 = never)")
 MACRO_CONFIG_INT(DbgHitch, dbg_hitch, 0, 0, 0, CFGFLAG_SERVER, "Hitch warnings")
+MACRO_CONFIG_INT(DbgSnapDelta, dbg_snap_delta, 0, 0, 1, CFGFLAG_SERVER, "Check the snapshot deltas against the original implementation")
 
 MACRO_CONFIG_INT(SvVanillaAntiSpoof, sv_vanilla_antispoof, 1, 0, 1, CFGFLAG_SERVER, "Enable vanilla Antispoof")
 MACRO_CONFIG_INT(SvVanConnPerSecond, sv_van_conn_per_second, 10, 1, 1000, CFGFLAG_SERVER, "Antispoof specific ratelimit")
@@ -58,6 +58,9 @@ struct CDatafileInfo
 struct CDatafile
 {
 	IOHANDLE m_File;
+	// the whole file mapped read-only, 0 if it is read through m_File
+	char *m_pMapping;
+	unsigned m_FileSize;
 	unsigned m_Crc;
 	CDatafileInfo m_Info;
 	CDatafileHeader m_Header;
@@ -77,9 +80,15 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		return false;
 	}
 
+	// map the file when possible, the data is then read in place
+	long FileSize = io_length(File);
+	char *pMapping = FileSize > 0 ? (char *)io_map(File, FileSize) : 0;
 
 	// take the CRC of the file and store it
 	unsigned Crc = 0;
+	if(pMapping)
+		Crc = crc32(Crc, (const Bytef *)pMapping, FileSize); // ignore_convention
+	else
 	{
 		enum
 		{
@@ -102,12 +111,18 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 
 	// TODO: change this header
 	CDatafileHeader Header;
-	io_read(File, &Header, sizeof(Header));
+	mem_zero(&Header, sizeof(Header));
+	if(pMapping)
+		mem_copy(&Header, pMapping, min((unsigned)sizeof(Header), (unsigned)FileSize));
+	else
+		io_read(File, &Header, sizeof(Header));
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
 	{
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+			io_unmap(pMapping, FileSize);
+			io_close(File);
 			return 0;
 		}
 	}
@@ -118,6 +133,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	if(Header.m_Version != 3 && Header.m_Version != 4)
 	{
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		io_unmap(pMapping, FileSize);
+		io_close(File);
 		return 0;
 	}
 
@@ -139,15 +156,26 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	pTmpDataFile->m_ppDataPtrs = (char**)(pTmpDataFile+1);
 	pTmpDataFile->m_pData = (char *)(pTmpDataFile+1)+Header.m_NumRawData*sizeof(char *);
 	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_pMapping = pMapping;
+	pTmpDataFile->m_FileSize = FileSize;
 	pTmpDataFile->m_Crc = Crc;
 
 	// clear the data pointers
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData*sizeof(void*));
 
-	// read types, offsets, sizes and item data
-	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
+	// read types, offsets, sizes and item data. they are copied even from
+	// the mapping, as the game patches some of the items
+	unsigned ReadSize;
+	if(pMapping)
+	{
+		ReadSize = min(Size, (unsigned)FileSize - min((unsigned)sizeof(CDatafileHeader), (unsigned)FileSize));
+		mem_copy(pTmpDataFile->m_pData, pMapping+sizeof(CDatafileHeader), ReadSize);
+	}
+	else
+		ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
 	if(ReadSize != Size)
 	{
+		io_unmap(pMapping, FileSize);
 		io_close(pTmpDataFile->m_File);
 		mem_free(pTmpDataFile);
 		pTmpDataFile = 0;
@@ -277,10 +305,16 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 		int SwapSize = DataSize;
 #endif
 
+		// the data in the mapping, if it is complete there
+		unsigned Offset = m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index];
+		char *pMapped = 0;
+		if(m_pDataFile->m_pMapping && DataSize >= 0 && Offset <= m_pDataFile->m_FileSize && (unsigned)DataSize <= m_pDataFile->m_FileSize-Offset)
+			pMapped = m_pDataFile->m_pMapping+Offset;
+
 		if(m_pDataFile->m_Header.m_Version == 4)
 		{
 			// v4 has compressed data
-			void *pTemp = (char *)mem_alloc(DataSize, 1);
+			void *pTemp = pMapped;
 			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
 			unsigned long s;
 
@@ -288,8 +322,12 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
 
 			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
+			if(!pMapped)
+			{
+				pTemp = mem_alloc(DataSize, 1);
+				io_seek(m_pDataFile->m_File, Offset, IOSEEK_START);
+				io_read(m_pDataFile->m_File, pTemp, DataSize);
+			}
 
 			// decompress the data, TODO: check for errors
 			s = UncompressedSize;
@@ -299,14 +337,23 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 #endif
 
 			// clean up the temporary buffers
-			mem_free(pTemp);
+			if(!pMapped)
+				mem_free(pTemp);
+		}
+#if !defined(CONF_ARCH_ENDIAN_BIG)
+		else if(pMapped)
+		{
+			// uncompressed data is used right from the mapping
+			dbg_msg("datafile", "mapping data index=%d size=%d", Index, DataSize);
+			m_pDataFile->m_ppDataPtrs[Index] = pMapped;
 		}
+#endif
 		else
 		{
 			// load the data
 			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(DataSize, 1);
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
+			io_seek(m_pDataFile->m_File, Offset, IOSEEK_START);
 			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
 		}
 
@@ -335,7 +382,8 @@ void CDataFileReader::UnloadData(int Index)
 		return;
 
 	//
-	mem_free(m_pDataFile->m_ppDataPtrs[Index]);
+	if(!IsMapped(m_pDataFile->m_ppDataPtrs[Index]))
+		mem_free(m_pDataFile->m_ppDataPtrs[Index]);
 	m_pDataFile->m_ppDataPtrs[Index] = 0x0;
 }
 
@@ -408,14 +456,50 @@ bool CDataFileReader::Close()
 	// free the data that is loaded
 	int i;
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
-		mem_free(m_pDataFile->m_ppDataPtrs[i]);
+		if(!IsMapped(m_pDataFile->m_ppDataPtrs[i]))
+			mem_free(m_pDataFile->m_ppDataPtrs[i]);
 
+	io_unmap(m_pDataFile->m_pMapping, m_pDataFile->m_FileSize);
 	io_close(m_pDataFile->m_File);
 	mem_free(m_pDataFile);
 	m_pDataFile = 0;
 	return true;
 }
 
+bool CDataFileReader::IsMapped(const void *pData) const
+{
+	const char *p = (const char *)pData;
+	return m_pDataFile->m_pMapping && p >= m_pDataFile->m_pMapping && p < m_pDataFile->m_pMapping+m_pDataFile->m_FileSize;
+}
+
+const void *CDataFileReader::FileData(unsigned *pSize) const
+{
+	if(!m_pDataFile || !m_pDataFile->m_pMapping)
+		return 0;
+	*pSize = m_pDataFile->m_FileSize;
+	return m_pDataFile->m_pMapping;
+}
+
+void CDataFileReader::MemoryUsage(int *pResident, int *pAllocated)
+{
+	*pResident = 0;
+	*pAllocated = 0;
+	if(!m_pDataFile)
+		return;
+
+	if(m_pDataFile->m_pMapping)
+		*pResident = io_map_resident(m_pDataFile->m_pMapping, m_pDataFile->m_FileSize);
+
+	// the info block and the data that was loaded or decompressed
+	*pAllocated = sizeof(CDatafile) + m_pDataFile->m_Header.m_NumRawData*sizeof(char *) + (m_pDataFile->m_DataStartOffset-sizeof(CDatafileHeader));
+	for(int i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
+	{
+		if(!m_pDataFile->m_ppDataPtrs[i] || IsMapped(m_pDataFile->m_ppDataPtrs[i]))
+			continue;
+		*pAllocated += m_pDataFile->m_Header.m_Version == 4 ? m_pDataFile->m_Info.m_pDataSizes[i] : GetDataSize(i);
+	}
+}
+
 unsigned CDataFileReader::Crc()
 {
 	if(!m_pDataFile) return 0xFFFFFFFF;
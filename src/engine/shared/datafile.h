@@ -8,11 +8,18 @@ class CDataFileReader
 {
 	struct CDatafile *m_pDataFile;
 	void *GetDataImpl(int Index, int Swap);
+	bool IsMapped(const void *pData) const;
 public:
 	CDataFileReader() : m_pDataFile(0) {}
 	~CDataFileReader() { Close(); }
 
 	bool IsOpen() const { return m_pDataFile != 0; }
+	void Swap(CDataFileReader *pOther)
+	{
+		struct CDatafile *pDataFile = m_pDataFile;
+		m_pDataFile = pOther->m_pDataFile;
+		pOther->m_pDataFile = pDataFile;
+	}
 
 	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
 	bool Close();
@@ -32,6 +39,11 @@ public:
 	void Unload();
 
 	unsigned Crc();
+
+	// the whole file when it is mapped into memory, 0 otherwise
+	const void *FileData(unsigned *pSize) const;
+	// resident bytes of the mapping and bytes allocated for the file
+	void MemoryUsage(int *pResident, int *pAllocated);
 };
 
 // write access
@@ -0,0 +1,67 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_HISTOGRAM_H
+#define ENGINE_SHARED_HISTOGRAM_H
+
+#include <base/system.h>
+
+/*
+	Class: CHistogram
+		Counts microsecond values in buckets of BUCKET_SIZE, so the
+		percentiles can be read without keeping every value. Values past
+		the last bucket are counted in it, the exact maximum is kept aside.
+*/
+class CHistogram
+{
+	enum
+	{
+		BUCKET_SIZE=10,
+		NUM_BUCKETS=2048,
+	};
+
+	int m_aBuckets[NUM_BUCKETS];
+	int m_Num;
+	int m_Max;
+
+public:
+	CHistogram() { Reset(); }
+
+	void Reset()
+	{
+		mem_zero(m_aBuckets, sizeof(m_aBuckets));
+		m_Num = 0;
+		m_Max = 0;
+	}
+
+	void Add(int Value)
+	{
+		if(Value < 0)
+			Value = 0;
+		int Bucket = Value/BUCKET_SIZE;
+		m_aBuckets[Bucket < NUM_BUCKETS ? Bucket : NUM_BUCKETS-1]++;
+		m_Num++;
+		if(Value > m_Max)
+			m_Max = Value;
+	}
+
+	int Num() const { return m_Num; }
+	int Max() const { return m_Max; }
+
+	// upper bound of the bucket the given percentile falls into
+	int Percentile(int Percent) const
+	{
+		if(!m_Num)
+			return 0;
+		int64 Wanted = ((int64)m_Num*Percent+99)/100;
+		int64 Count = 0;
+		for(int i = 0; i < NUM_BUCKETS-1; i++)
+		{
+			Count += m_aBuckets[i];
+			if(Count >= Wanted)
+				return (i+1)*BUCKET_SIZE < m_Max ? (i+1)*BUCKET_SIZE : m_Max;
+		}
+		return m_Max;
+	}
+};
+
+#endif
@@ -1,14 +1,39 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
+#include <base/tl/threading.h>
 #include "jobs.h"
 
 CJobPool::CJobPool()
 {
 	// empty the pool
 	m_Lock = lock_create();
+#if !defined(CONF_PLATFORM_MACOSX)
+	semaphore_init(&m_Semaphore);
+#endif
 	m_pFirstJob = 0;
 	m_pLastJob = 0;
+	m_NumThreads = 0;
+}
+
+CJob *CJobPool::FetchJob()
+{
+	CJob *pJob = 0;
+
+	// fetch job from queue
+	lock_wait(m_Lock);
+	if(m_pFirstJob)
+	{
+		pJob = m_pFirstJob;
+		m_pFirstJob = m_pFirstJob->m_pNext;
+		if(m_pFirstJob)
+			m_pFirstJob->m_pPrev = 0;
+		else
+			m_pLastJob = 0;
+		pJob->m_Status = CJob::STATE_RUNNING;
+	}
+	lock_release(m_Lock);
+	return pJob;
 }
 
 void CJobPool::WorkerThread(void *pUser)
@@ -17,30 +42,23 @@ void CJobPool::WorkerThread(void *pUser)
 
 	while(1)
 	{
-		CJob *pJob = 0;
-
-		// fetch job from queue
-		lock_wait(pPool->m_Lock);
-		if(pPool->m_pFirstJob)
-		{
-			pJob = pPool->m_pFirstJob;
-			pPool->m_pFirstJob = pPool->m_pFirstJob->m_pNext;
-			if(pPool->m_pFirstJob)
-				pPool->m_pFirstJob->m_pPrev = 0;
-			else
-				pPool->m_pLastJob = 0;
-		}
-		lock_release(pPool->m_Lock);
+#if !defined(CONF_PLATFORM_MACOSX)
+		// every added job signals once, the job might have been taken by RunJob already
+		semaphore_wait(&pPool->m_Semaphore);
+#endif
+		CJob *pJob = pPool->FetchJob();
 
 		// do the job if we have one
 		if(pJob)
 		{
-			pJob->m_Status = CJob::STATE_RUNNING;
 			pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
+			sync_barrier();
 			pJob->m_Status = CJob::STATE_DONE;
 		}
+#if defined(CONF_PLATFORM_MACOSX)
 		else
 			thread_sleep(10);
+#endif
 	}
 
 }
@@ -50,6 +68,7 @@ int CJobPool::Init(int NumThreads)
 	// start threads
 	for(int i = 0; i < NumThreads; i++)
 		teethread_create(WorkerThread, this);
+	m_NumThreads += NumThreads;
 	return 0;
 }
 
@@ -70,6 +89,21 @@ int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
 		m_pFirstJob = pJob;
 
 	lock_release(m_Lock);
+
+#if !defined(CONF_PLATFORM_MACOSX)
+	semaphore_signal(&m_Semaphore);
+#endif
 	return 0;
 }
 
+int CJobPool::RunJob()
+{
+	CJob *pJob = FetchJob();
+	if(!pJob)
+		return 0;
+
+	pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
+	sync_barrier();
+	pJob->m_Status = CJob::STATE_DONE;
+	return 1;
+}
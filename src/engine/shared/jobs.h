@@ -2,6 +2,8 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef ENGINE_SHARED_JOBS_H
 #define ENGINE_SHARED_JOBS_H
+#include <base/system.h>
+
 typedef int (*JOBFUNC)(void *pData);
 
 class CJobPool;
@@ -40,9 +42,14 @@ public:
 class CJobPool
 {
 	LOCK m_Lock;
+#if !defined(CONF_PLATFORM_MACOSX)
+	SEMAPHORE m_Semaphore;
+#endif
 	CJob *m_pFirstJob;
 	CJob *m_pLastJob;
+	int m_NumThreads;
 
+	CJob *FetchJob();
 	static void WorkerThread(void *pUser);
 
 public:
@@ -50,5 +57,9 @@ public:
 
 	int Init(int NumThreads);
 	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData);
+
+	// runs one pending job on the calling thread, returns 0 if there was none
+	int RunJob();
+	int NumThreads() const { return m_NumThreads; }
 };
 #endif
@@ -8,8 +8,10 @@
 class CMap : public IEngineMap
 {
 	CDataFileReader m_DataFile;
+	CMap *m_pStaged;
 public:
-	CMap() {}
+	CMap() : m_pStaged(0) {}
+	~CMap() { delete m_pStaged; }
 
 	virtual void *GetData(int Index) { return m_DataFile.GetData(Index); }
 	virtual void *GetDataSwapped(int Index) { return m_DataFile.GetDataSwapped(Index); }
@@ -41,6 +43,51 @@ public:
 	{
 		return m_DataFile.Crc();
 	}
+
+	virtual const unsigned char *FileData(unsigned *pSize)
+	{
+		return (const unsigned char *)m_DataFile.FileData(pSize);
+	}
+
+	virtual void MemoryUsage(int *pResident, int *pAllocated)
+	{
+		m_DataFile.MemoryUsage(pResident, pAllocated);
+	}
+
+	virtual bool LoadStaged(const char *pMapName)
+	{
+		IStorage *pStorage = Kernel()->RequestInterface<IStorage>();
+		if(!pStorage)
+			return false;
+		if(!m_pStaged)
+			m_pStaged = new CMap;
+		m_pStaged->Unload();
+		return m_pStaged->m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL);
+	}
+
+	virtual IEngineMap *Staged()
+	{
+		return m_pStaged;
+	}
+
+	virtual unsigned StagedCrc()
+	{
+		return m_pStaged ? m_pStaged->Crc() : 0;
+	}
+
+	virtual void SwapStaged()
+	{
+		if(!m_pStaged)
+			return;
+		m_DataFile.Swap(&m_pStaged->m_DataFile);
+		m_pStaged->Unload();
+	}
+
+	virtual void UnloadStaged()
+	{
+		if(m_pStaged)
+			m_pStaged->Unload();
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
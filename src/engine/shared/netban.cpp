@@ -300,49 +300,68 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 	Info.m_Expires = Stamp;
 	str_copy(Info.m_aReason, pReason, sizeof(Info.m_aReason));
 
-	// check if it already exists
-	CNetHash NetHash(pData);
-	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
-	if(pBan)
+	// the result is printed once the lock is released, printing can wait
+	// on the network thread
+	int Result;
+	char aBuf[128];
 	{
-		// adjust the ban
-		pBanPool->Update(pBan, &Info);
-		char aBuf[128];
-		MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_LIST);
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		return 1;
-	}
+		scope_lock Lock(&m_Lock);
 
-	// add ban and print result
-	pBan = pBanPool->Add(pData, &Info, &NetHash);
-	if(pBan)
-	{
-		char aBuf[128];
-		MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_BANADD);
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		return 0;
+		// check if it already exists
+		CNetHash NetHash(pData);
+		CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
+		if(pBan)
+		{
+			// adjust the ban
+			pBanPool->Update(pBan, &Info);
+			MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_LIST);
+			Result = 1;
+		}
+		else
+		{
+			// add ban
+			pBan = pBanPool->Add(pData, &Info, &NetHash);
+			if(pBan)
+			{
+				MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_BANADD);
+				Result = 0;
+			}
+			else
+			{
+				str_copy(aBuf, "ban failed (full banlist)", sizeof(aBuf));
+				Result = -1;
+			}
+		}
 	}
-	else
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban failed (full banlist)");
-	return -1;
+
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+	return Result;
 }
 
 template<class T>
 int CNetBan::Unban(T *pBanPool, const typename T::CDataType *pData)
 {
-	CNetHash NetHash(pData);
-	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
-	if(pBan)
+	int Result;
+	char aBuf[256];
 	{
-		char aBuf[256];
-		MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_BANREM);
-		pBanPool->Remove(pBan);
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		return 0;
+		scope_lock Lock(&m_Lock);
+		CNetHash NetHash(pData);
+		CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
+		if(pBan)
+		{
+			MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_BANREM);
+			pBanPool->Remove(pBan);
+			Result = 0;
+		}
+		else
+		{
+			str_copy(aBuf, "unban failed (invalid entry)", sizeof(aBuf));
+			Result = -1;
+		}
 	}
-	else
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban failed (invalid entry)");
-	return -1;
+
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+	return Result;
 }
 
 void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
@@ -368,19 +387,26 @@ void CNetBan::Update()
 {
 	int Now = time_timestamp();
 
-	// remove expired bans
+	// remove expired bans, one at a time so the lock isn't held while printing
 	char aBuf[256], aNetStr[256];
-	while(m_BanAddrPool.First() && m_BanAddrPool.First()->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER && m_BanAddrPool.First()->m_Info.m_Expires < Now)
-	{
-		str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanAddrPool.First()->m_Data, aNetStr, sizeof(aNetStr)));
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		m_BanAddrPool.Remove(m_BanAddrPool.First());
-	}
-	while(m_BanRangePool.First() && m_BanRangePool.First()->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER && m_BanRangePool.First()->m_Info.m_Expires < Now)
+	while(1)
 	{
-		str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanRangePool.First()->m_Data, aNetStr, sizeof(aNetStr)));
+		{
+			scope_lock Lock(&m_Lock);
+			if(m_BanAddrPool.First() && m_BanAddrPool.First()->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER && m_BanAddrPool.First()->m_Info.m_Expires < Now)
+			{
+				str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanAddrPool.First()->m_Data, aNetStr, sizeof(aNetStr)));
+				m_BanAddrPool.Remove(m_BanAddrPool.First());
+			}
+			else if(m_BanRangePool.First() && m_BanRangePool.First()->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER && m_BanRangePool.First()->m_Info.m_Expires < Now)
+			{
+				str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanRangePool.First()->m_Data, aNetStr, sizeof(aNetStr)));
+				m_BanRangePool.Remove(m_BanRangePool.First());
+			}
+			else
+				break;
+		}
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		m_BanRangePool.Remove(m_BanRangePool.First());
 	}
 }
 
@@ -416,27 +442,33 @@ int CNetBan::UnbanByIndex(int Index)
 {
 	int Result;
 	char aBuf[256];
-	CBanAddr *pBan = m_BanAddrPool.Get(Index);
-	if(pBan)
-	{
-		NetToString(&pBan->m_Data, aBuf, sizeof(aBuf));
-		Result = m_BanAddrPool.Remove(pBan);
-	}
-	else
 	{
-		CBanRange *pBan = m_BanRangePool.Get(Index-m_BanAddrPool.Num());
+		scope_lock Lock(&m_Lock);
+		CBanAddr *pBan = m_BanAddrPool.Get(Index);
 		if(pBan)
 		{
 			NetToString(&pBan->m_Data, aBuf, sizeof(aBuf));
-			Result = m_BanRangePool.Remove(pBan);
+			Result = m_BanAddrPool.Remove(pBan);
 		}
 		else
 		{
-			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban failed (invalid index)");
-			return -1;
+			CBanRange *pBan = m_BanRangePool.Get(Index-m_BanAddrPool.Num());
+			if(pBan)
+			{
+				NetToString(&pBan->m_Data, aBuf, sizeof(aBuf));
+				Result = m_BanRangePool.Remove(pBan);
+			}
+			else
+				aBuf[0] = 0;
 		}
 	}
 
+	if(!aBuf[0])
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban failed (invalid index)");
+		return -1;
+	}
+
 	char aMsg[256];
 	str_format(aMsg, sizeof(aMsg), "unbanned index %i (%s)", Index, aBuf);
 	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aMsg);
@@ -445,6 +477,7 @@ int CNetBan::UnbanByIndex(int Index)
 
 bool CNetBan::IsBanned(const NETADDR *pAddr, char *pBuf, unsigned BufferSize) const
 {
+	scope_lock Lock(&m_Lock);
 	CNetHash aHash[17];
 	int Length = CNetHash::MakeHashArray(pAddr, aHash);
 
@@ -2,6 +2,7 @@
 #define ENGINE_SHARED_NETBAN_H
 
 #include <base/system.h>
+#include <base/tl/threading.h>
 
 
 inline int NetComp(const NETADDR *pAddr1, const NETADDR *pAddr2)
@@ -157,6 +158,9 @@ protected:
 	CBanRangePool m_BanRangePool;
 	NETADDR m_LocalhostIPV4, m_LocalhostIPV6;
 
+	// guards the pools against IsBanned calls from the network thread
+	mutable lock m_Lock;
+
 public:
 	enum
 	{
@@ -178,7 +182,7 @@ public:
 	int UnbanByAddr(const NETADDR *pAddr);
 	int UnbanByRange(const CNetRange *pRange);
 	int UnbanByIndex(int Index);
-	void UnbanAll() { m_BanAddrPool.Reset(); m_BanRangePool.Reset(); }
+	void UnbanAll() { scope_lock Lock(&m_Lock); m_BanAddrPool.Reset(); m_BanRangePool.Reset(); }
 	bool IsBanned(const NETADDR *pAddr, char *pBuf, unsigned BufferSize) const;
 
 	static void ConBan(class IConsole::IResult *pResult, void *pUser);
@@ -91,7 +91,7 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 }
 static const unsigned char NET_HEADER_EXTENDED[] = {'x', 'e'};
 // packs the data tight and sends it
-void CNetBase::SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize, bool Extended, unsigned char aExtra[4])
+void CNetBase::SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize, bool Extended, unsigned char aExtra[4], CNetSendQueue *pQueue)
 {
 	unsigned char aBuffer[NET_MAX_PACKETSIZE];
 	const int DATA_OFFSET = 6;
@@ -106,10 +106,13 @@ void CNetBase::SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *
 		mem_copy(aBuffer + sizeof(NET_HEADER_EXTENDED), aExtra, 4);
 	}
 	mem_copy(aBuffer + DATA_OFFSET, pData, DataSize);
-	net_udp_send(Socket, pAddr, aBuffer, DataSize + DATA_OFFSET);
+	if(pQueue)
+		pQueue->Send(pAddr, aBuffer, DataSize + DATA_OFFSET);
+	else
+		net_udp_send(Socket, pAddr, aBuffer, DataSize + DATA_OFFSET);
 }
 
-void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken)
+void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken, CNetSendQueue *pQueue)
 {
 	unsigned char aBuffer[NET_MAX_PACKETSIZE];
 	int CompressedSize = -1;
@@ -158,7 +161,10 @@ void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct
 		aBuffer[0] = ((pPacket->m_Flags<<4)&0xf0)|((pPacket->m_Ack>>8)&0xf);
 		aBuffer[1] = pPacket->m_Ack&0xff;
 		aBuffer[2] = pPacket->m_NumChunks;
-		net_udp_send(Socket, pAddr, aBuffer, FinalSize);
+		if(pQueue)
+			pQueue->Send(pAddr, aBuffer, FinalSize);
+		else
+			net_udp_send(Socket, pAddr, aBuffer, FinalSize);
 
 		// log raw socket data
 		if(ms_DataLogSent)
@@ -250,7 +256,7 @@ int CNetBase::UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct
 }
 
 
-void CNetBase::SendControlMsg(NETSOCKET Socket, NETADDR *pAddr, int Ack, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken)
+void CNetBase::SendControlMsg(NETSOCKET Socket, NETADDR *pAddr, int Ack, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken, CNetSendQueue *pQueue)
 {
 	CNetPacketConstruct Construct;
 	Construct.m_Flags = NET_PACKETFLAG_CONTROL;
@@ -261,7 +267,59 @@ void CNetBase::SendControlMsg(NETSOCKET Socket, NETADDR *pAddr, int Ack, int Con
 	mem_copy(&Construct.m_aChunkData[1], pExtra, ExtraSize);
 
 	// send the control message
-	CNetBase::SendPacket(Socket, pAddr, &Construct, SecurityToken);
+	CNetBase::SendPacket(Socket, pAddr, &Construct, SecurityToken, pQueue);
+}
+
+void CNetSendQueue::Init(NETSOCKET Socket)
+{
+	m_Socket = Socket;
+	m_NumPackets = 0;
+	m_Syscalls = 0;
+	m_Packets = 0;
+	m_Flushes = 0;
+	m_FlushTime = 0;
+	m_MaxFlushTime = 0;
+}
+
+void CNetSendQueue::Send(const NETADDR *pAddr, const void *pData, int DataSize)
+{
+	if(!g_Config.m_SvNetSendBatch)
+	{
+		// keep the packet order if batching just got disabled
+		if(m_NumPackets)
+			Flush();
+		net_udp_send(m_Socket, pAddr, pData, DataSize);
+		m_Syscalls++;
+		m_Packets++;
+		return;
+	}
+
+	if(m_NumPackets == NET_MAX_SEND_QUEUE)
+		Flush();
+
+	m_aAddr[m_NumPackets] = *pAddr;
+	m_aSize[m_NumPackets] = DataSize;
+	mem_copy(&m_aData[m_NumPackets*NET_MAX_PACKETSIZE], pData, DataSize);
+	m_NumPackets++;
+}
+
+void CNetSendQueue::Flush()
+{
+	if(!m_NumPackets)
+		return;
+
+	int64 StartTime = time_get();
+	int Syscalls = 0;
+	net_udp_send_batch(m_Socket, m_aAddr, m_aData, m_aSize, NET_MAX_PACKETSIZE, m_NumPackets, &Syscalls);
+	int64 FlushTime = time_get()-StartTime;
+
+	m_Syscalls += Syscalls;
+	m_Packets += m_NumPackets;
+	m_Flushes++;
+	m_FlushTime += FlushTime;
+	if(FlushTime > m_MaxFlushTime)
+		m_MaxFlushTime = FlushTime;
+	m_NumPackets = 0;
 }
 
 
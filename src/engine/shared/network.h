@@ -54,8 +54,12 @@ enum
 	NET_MAX_PAYLOAD = NET_MAX_PACKETSIZE-6,
 	NET_MAX_CHUNKHEADERSIZE = 5,
 	NET_PACKETHEADERSIZE = 3,
-	NET_MAX_CLIENTS = 64,
+	NET_MAX_CLIENTS = 128,
 	NET_MAX_CONSOLE_CLIENTS = 4,
+	NET_MAX_RECV_BATCH = 64,
+	NET_MAX_SEND_QUEUE = 256,
+	NET_ADDR_HASH_SIZE = 256,
+	NET_THREAD_QUEUE_SIZE = 2048,
 	NET_MAX_SEQUENCE = 1<<10,
 	NET_SEQUENCE_MASK = NET_MAX_SEQUENCE-1,
 
@@ -148,6 +152,46 @@ public:
 	unsigned char m_aExtraData[4];
 };
 
+// collects finished packets so they can be handed to the kernel in batches
+class CNetSendQueue
+{
+	NETSOCKET m_Socket;
+	unsigned char m_aData[NET_MAX_SEND_QUEUE*NET_MAX_PACKETSIZE];
+	NETADDR m_aAddr[NET_MAX_SEND_QUEUE];
+	int m_aSize[NET_MAX_SEND_QUEUE];
+	int m_NumPackets;
+
+	int64 m_Syscalls;
+	int64 m_Packets;
+	int64 m_Flushes;
+	int64 m_FlushTime;
+	int64 m_MaxFlushTime;
+
+public:
+	void Init(NETSOCKET Socket);
+	void Send(const NETADDR *pAddr, const void *pData, int DataSize);
+	void Flush();
+
+	int64 Syscalls() const { return m_Syscalls; }
+	int64 Packets() const { return m_Packets; }
+	int64 Flushes() const { return m_Flushes; }
+	int64 FlushTime() const { return m_FlushTime; }
+	int64 MaxFlushTime() const { return m_MaxFlushTime; }
+	void ResetMaxFlushTime() { m_MaxFlushTime = 0; }
+};
+
+// traffic counters of the server socket, see CNetServer::RequestStats
+struct CNetStats
+{
+	int64 m_RecvPackets;
+	int64 m_RecvSyscalls;
+	int64 m_SendPackets;
+	int64 m_SendSyscalls;
+	int64 m_SendFlushes;
+	int64 m_SendFlushTime;
+	int64 m_SendMaxFlushTime; // since the last request
+};
+
 
 class CNetConnection
 {
@@ -179,6 +223,7 @@ private:
 
 	NETADDR m_PeerAddr;
 	NETSOCKET m_Socket;
+	CNetSendQueue *m_pSendQueue;
 	NETSTATS m_Stats;
 public:
 	bool m_TimeoutProtected;
@@ -200,7 +245,7 @@ private:
 public:
 	void Reset(bool Rejoin=false);
 
-	void Init(NETSOCKET Socket, bool BlockCloseMsg);
+	void Init(NETSOCKET Socket, bool BlockCloseMsg, CNetSendQueue *pSendQueue=0);
 	int Connect(NETADDR *pAddr);
 	void Disconnect(const char *pReason);
 
@@ -286,14 +331,58 @@ class CNetServer
 	{
 	public:
 		CNetConnection m_Connection;
+
+		// address index chains
+		bool m_Indexed;
+		int m_NextAddr;
+		int m_NextIP;
+
+		// bumped for every accepted client, tags events of the network thread
+		int m_Generation;
 	};
 
+	// message between the network thread and the game thread
+	struct CNetEvent
+	{
+		int m_Type;
+		int m_ClientID;
+		int m_Generation;
+		int m_Flags;
+		NETADDR m_Address;
+		int m_DataSize;
+		unsigned char m_aExtraData[4];
+		unsigned char m_aData[NET_MAX_PAYLOAD];
+	};
+
+	enum
+	{
+		// network thread -> game thread
+		NETEVENT_CHUNK=0,
+		NETEVENT_NEWCLIENT,
+		NETEVENT_NEWCLIENT_NOAUTH,
+		NETEVENT_DELCLIENT,
+		NETEVENT_REJOIN,
+		NETEVENT_BAN,
+		NETEVENT_STATS,
+
+		// game thread -> network thread
+		NETEVENT_SEND,
+		NETEVENT_DROP,
+		NETEVENT_STATS_REQUEST,
+	};
+
+	typedef TSpscRingBuffer<CNetEvent, NET_THREAD_QUEUE_SIZE> CNetEventQueue;
+
 	NETSOCKET m_Socket;
 	class CNetBan *m_pNetBan;
 	CSlot m_aSlots[NET_MAX_CLIENTS];
 	int m_MaxClients;
 	int m_MaxClientsPerIP;
 
+	// hash buckets keyed by the full address and by the address without port
+	int m_aAddrHash[NET_ADDR_HASH_SIZE];
+	int m_aIPHash[NET_ADDR_HASH_SIZE];
+
 	NETFUNC_NEWCLIENT m_pfnNewClient;
 	NETFUNC_NEWCLIENT_NOAUTH m_pfnNewClientNoAuth;
 	NETFUNC_DELCLIENT m_pfnDelClient;
@@ -306,12 +395,58 @@ class CNetServer
 	int m_VConnNum;
 
 	CNetRecvUnpacker m_RecvUnpacker;
+	CNetSendQueue m_SendQueue;
+
+	// batched receive
+	unsigned char m_aRecvBatchData[NET_MAX_RECV_BATCH*NET_MAX_PACKETSIZE];
+	NETADDR m_aRecvBatchAddr[NET_MAX_RECV_BATCH];
+	int m_aRecvBatchSize[NET_MAX_RECV_BATCH];
+	int m_RecvBatchNum;
+	int m_RecvBatchPos;
+	int64 m_RecvPackets;
+	int64 m_RecvSyscalls;
 
 	int m_NumConAttempts; // log flooding attacks
 	int64 m_TimeNumConAttempts;
 
 	unsigned char m_SecurityTokenSeed[16];
 
+	// network thread, everything above is owned by it while it runs
+	void *m_pThread;
+	volatile bool m_Threaded;
+	volatile unsigned m_StopThread;
+	volatile unsigned m_ThreadDone;
+	CNetEventQueue *m_pInQueue;
+	CNetEventQueue *m_pOutQueue;
+	bool m_InEventPending;
+
+	// the game thread's view of the slots while the network thread runs
+	int m_aGameGeneration[NET_MAX_CLIENTS];
+	NETADDR m_aGameAddr[NET_MAX_CLIENTS];
+	bool m_aGameSecurityToken[NET_MAX_CLIENTS];
+	CNetStats m_GameStats;
+	bool m_GameStatsReady;
+
+	static void NetThread(void *pUser);
+	CNetEvent *NewInEvent();
+	CNetEvent *NewOutEvent();
+	void ProcessOutEvents();
+	void PumpRecv();
+	int RecvThreaded(CNetChunk *pChunk);
+	int SendThreaded(CNetChunk *pChunk);
+	int DropThreaded(int ClientID, const char *pReason);
+
+	// network side implementations, run by the network thread if there is one
+	int RecvNet(CNetChunk *pChunk);
+	int SendNet(CNetChunk *pChunk);
+	int UpdateNet();
+	int DropNet(int ClientID, const char *pReason);
+	void OnNewClient(int Slot, bool NoAuth);
+	void OnDelClient(int Slot, const char *pReason);
+	void OnClientRejoin(int Slot);
+	void OnStressBan(int Slot);
+	void GatherStats(CNetStats *pStats);
+
 	void OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, const CNetPacketConstruct &Packet);
 	void OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketConstruct &Packet);
 	void OnPreConnMsg(NETADDR &Addr, const CNetPacketConstruct &Packet);
@@ -320,6 +455,9 @@ class CNetServer
 	void OnPreConnMsg(NETADDR &Addr, CNetPacketConstruct &Packet);
 	void SendControl(NETADDR &Addr, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken);
 
+	int FetchPacket(NETADDR *pAddr, unsigned char **ppData);
+	void IndexSlot(int Slot);
+	void UnindexSlot(int Slot);
 	int TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, bool VanillaAuth=false);
 	int NumClientsWithAddr(NETADDR Addr);
 	void SendMsgs(NETADDR &Addr, const CMsgPacker *Msgs[], int num);
@@ -340,12 +478,24 @@ public:
 	int Drop(int ClientID, const char *pReason);
 
 	// status requests
-	const NETADDR *ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
-	bool HasSecurityToken(int ClientID) const { return m_aSlots[ClientID].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED; }
+	const NETADDR *ClientAddr(int ClientID) const { return m_Threaded ? &m_aGameAddr[ClientID] : m_aSlots[ClientID].m_Connection.PeerAddress(); }
+	bool HasSecurityToken(int ClientID) const { return m_Threaded ? m_aGameSecurityToken[ClientID] : m_aSlots[ClientID].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED; }
 	NETSOCKET Socket() const { return m_Socket; }
 	class CNetBan *NetBan() const { return m_pNetBan; }
 	int NetType() const { return m_Socket.type; }
 	int MaxClients() const { return m_MaxClients; }
+	void FlushSendQueue() { if(!m_Threaded) m_SendQueue.Flush(); }
+
+	// network thread
+	bool StartThread();
+	void StopThread();
+	bool Threaded() const { return m_Threaded; }
+	// the counters belong to the network thread, they are copied over
+	// by it some time after the request
+	void RequestStats();
+	bool PollStats(CNetStats *pStats);
+	// waits for data on the socket, at most Microseconds
+	void Wait(int Microseconds);
 
 	//
 	void SetMaxClientsPerIP(int Max);
@@ -407,9 +557,9 @@ public:
 	static int Compress(const void *pData, int DataSize, void *pOutput, int OutputSize);
 	static int Decompress(const void *pData, int DataSize, void *pOutput, int OutputSize);
 
-	static void SendControlMsg(NETSOCKET Socket, NETADDR *pAddr, int Ack, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken);
-	static void SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize, bool Extended, unsigned char aExtra[4]);
-	static void SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken);
+	static void SendControlMsg(NETSOCKET Socket, NETADDR *pAddr, int Ack, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken, CNetSendQueue *pQueue=0);
+	static void SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize, bool Extended, unsigned char aExtra[4], CNetSendQueue *pQueue=0);
+	static void SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken, CNetSendQueue *pQueue=0);
 	static int UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct *pPacket);
 
 	// The backroom is ack-NET_MAX_SEQUENCE/2. Used for knowing if we acked a packet or not
@@ -19,6 +19,29 @@ static SECURITY_TOKEN ToSecurityToken(const unsigned char* pData)
 	return (int)pData[0] | (pData[1] << 8) | (pData[2] << 16) | (pData[3] << 24);
 }
 
+static unsigned AddrHash(const NETADDR &Addr, bool WithPort)
+{
+	// FNV-1a over the fields, padding bytes are left out
+	unsigned Hash = 2166136261u;
+	Hash = (Hash^Addr.type)*16777619u;
+	for(int i = 0; i < 16; i++)
+		Hash = (Hash^Addr.ip[i])*16777619u;
+	if(WithPort)
+	{
+		Hash = (Hash^(Addr.port&0xff))*16777619u;
+		Hash = (Hash^(Addr.port>>8))*16777619u;
+	}
+	return Hash&(NET_ADDR_HASH_SIZE-1);
+}
+
+static bool SameIP(const NETADDR &a, const NETADDR &b)
+{
+	NETADDR A = a, B = b;
+	A.port = 0;
+	B.port = 0;
+	return net_addr_comp(&A, &B) == 0;
+}
+
 bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int MaxClientsPerIP, int Flags)
 {
 	// zero out the whole structure
@@ -49,8 +72,21 @@ bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int Ma
 
 	secure_random_fill(m_SecurityTokenSeed, sizeof(m_SecurityTokenSeed));
 
+	m_SendQueue.Init(m_Socket);
+
+	for(int i = 0; i < NET_ADDR_HASH_SIZE; i++)
+	{
+		m_aAddrHash[i] = -1;
+		m_aIPHash[i] = -1;
+	}
+
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
-		m_aSlots[i].m_Connection.Init(m_Socket, true);
+	{
+		m_aSlots[i].m_Connection.Init(m_Socket, true, &m_SendQueue);
+		m_aSlots[i].m_Indexed = false;
+		m_aSlots[i].m_NextAddr = -1;
+		m_aSlots[i].m_NextIP = -1;
+	}
 
 	return true;
 }
@@ -80,6 +116,25 @@ int CNetServer::Close()
 
 int CNetServer::Drop(int ClientID, const char *pReason)
 {
+	if(m_Threaded)
+		return DropThreaded(ClientID, pReason);
+	return DropNet(ClientID, pReason);
+}
+
+int CNetServer::DropNet(int ClientID, const char *pReason)
+{
+	if(m_Threaded)
+	{
+		// close the slot before the event is queued, waiting for room
+		// in the queue can run further sends for this client
+		char aReason[128];
+		str_copy(aReason, pReason, sizeof(aReason));
+		m_aSlots[ClientID].m_Connection.Disconnect(aReason);
+		UnindexSlot(ClientID);
+		OnDelClient(ClientID, aReason);
+		return 0;
+	}
+
 	// TODO: insert lots of checks here
 	/*NETADDR Addr = ClientAddr(ClientID);
 
@@ -88,15 +143,62 @@ int CNetServer::Drop(int ClientID, const char *pReason)
 		Addr.ip[0], Addr.ip[1], Addr.ip[2], Addr.ip[3],
 		pReason
 		);*/
-	if(m_pfnDelClient)
-		m_pfnDelClient(ClientID, pReason, m_UserPtr);
+	OnDelClient(ClientID, pReason);
 
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
+	UnindexSlot(ClientID);
 
 	return 0;
 }
 
+void CNetServer::IndexSlot(int Slot)
+{
+	if(m_aSlots[Slot].m_Indexed)
+		UnindexSlot(Slot);
+
+	const NETADDR *pAddr = m_aSlots[Slot].m_Connection.PeerAddress();
+	unsigned AddrBucket = AddrHash(*pAddr, true);
+	unsigned IPBucket = AddrHash(*pAddr, false);
+
+	m_aSlots[Slot].m_NextAddr = m_aAddrHash[AddrBucket];
+	m_aAddrHash[AddrBucket] = Slot;
+	m_aSlots[Slot].m_NextIP = m_aIPHash[IPBucket];
+	m_aIPHash[IPBucket] = Slot;
+	m_aSlots[Slot].m_Indexed = true;
+}
+
+void CNetServer::UnindexSlot(int Slot)
+{
+	if(!m_aSlots[Slot].m_Indexed)
+		return;
+
+	const NETADDR *pAddr = m_aSlots[Slot].m_Connection.PeerAddress();
+
+	int *pLink = &m_aAddrHash[AddrHash(*pAddr, true)];
+	while(*pLink != -1 && *pLink != Slot)
+		pLink = &m_aSlots[*pLink].m_NextAddr;
+	if(*pLink == Slot)
+		*pLink = m_aSlots[Slot].m_NextAddr;
+
+	pLink = &m_aIPHash[AddrHash(*pAddr, false)];
+	while(*pLink != -1 && *pLink != Slot)
+		pLink = &m_aSlots[*pLink].m_NextIP;
+	if(*pLink == Slot)
+		*pLink = m_aSlots[Slot].m_NextIP;
+
+	m_aSlots[Slot].m_NextAddr = -1;
+	m_aSlots[Slot].m_NextIP = -1;
+	m_aSlots[Slot].m_Indexed = false;
+}
+
 int CNetServer::Update()
+{
+	if(m_Threaded)
+		return 0;
+	return UpdateNet();
+}
+
+int CNetServer::UpdateNet()
 {
 	int64 Now = time_get();
 	for(int i = 0; i < MaxClients(); i++)
@@ -105,12 +207,9 @@ int CNetServer::Update()
 		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
 		{
 			if(Now - m_aSlots[i].m_Connection.ConnectTime() < time_freq() && NetBan())
-			{
-				if(NetBan()->BanAddr(ClientAddr(i), 60, "Stressing network") == -1)
-					Drop(i, m_aSlots[i].m_Connection.ErrorString());
-			}
+				OnStressBan(i);
 			else
-				Drop(i, m_aSlots[i].m_Connection.ErrorString());
+				DropNet(i, m_aSlots[i].m_Connection.ErrorString());
 		}
 	}
 
@@ -144,20 +243,15 @@ void CNetServer::SendControl(NETADDR &Addr, int ControlMsg, const void *pExtra,
 
 int CNetServer::NumClientsWithAddr(NETADDR Addr)
 {
-	NETADDR ThisAddr = Addr, OtherAddr;
-
 	int FoundAddr = 0;
-	ThisAddr.port = 0;
 
-	for(int i = 0; i < MaxClients(); ++i)
+	for(int i = m_aIPHash[AddrHash(Addr, false)]; i != -1; i = m_aSlots[i].m_NextIP)
 	{
 		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE ||
 			m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
 			continue;
 
-		OtherAddr = *m_aSlots[i].m_Connection.PeerAddress();
-		OtherAddr.port = 0;
-		if(!net_addr_comp(&ThisAddr, &OtherAddr))
+		if(SameIP(Addr, *m_aSlots[i].m_Connection.PeerAddress()))
 			FoundAddr++;
 	}
 
@@ -196,6 +290,7 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 
 	// init connection slot
 	m_aSlots[Slot].m_Connection.DirectInit(Addr, SecurityToken);
+	IndexSlot(Slot);
 
 	if (VanillaAuth)
 	{
@@ -214,10 +309,8 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 	}
 
 
-	if (VanillaAuth)
-		m_pfnNewClientNoAuth(Slot, m_UserPtr);
-	else
-		m_pfnNewClient(Slot, m_UserPtr);
+	m_aSlots[Slot].m_Generation++;
+	OnNewClient(Slot, VanillaAuth);
 
 	return Slot; // done
 }
@@ -444,7 +537,7 @@ void CNetServer::OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, cons
 
 			// reset netconn and process rejoin
 			m_aSlots[ClientID].m_Connection.Reset(true);
-			m_pfnClientRejoin(ClientID, m_UserPtr);
+			OnClientRejoin(ClientID);
 		}
 	}
 }
@@ -491,18 +584,17 @@ void CNetServer::OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketC
 
 int CNetServer::GetClientSlot(const NETADDR &Addr)
 {
-	int Slot = -1;
-	for(int i = 0; i < MaxClients(); i++)
+	for(int i = m_aAddrHash[AddrHash(Addr, true)]; i != -1; i = m_aSlots[i].m_NextAddr)
 	{
 		if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE &&
 			m_aSlots[i].m_Connection.State() != NET_CONNSTATE_ERROR &&
 			net_addr_comp(m_aSlots[i].m_Connection.PeerAddress(), &Addr) == 0)
 		{
-			Slot = i;
+			return i;
 		}
 	}
 
-	return Slot;
+	return -1;
 }
 
 static bool IsDDNetControlMsg(const CNetPacketConstruct *pPacket)
@@ -528,21 +620,63 @@ static bool IsDDNetControlMsg(const CNetPacketConstruct *pPacket)
 	return false;
 }
 
+int CNetServer::FetchPacket(NETADDR *pAddr, unsigned char **ppData)
+{
+	int BatchSize = min(g_Config.m_SvNetRecvBatch, (int)NET_MAX_RECV_BATCH);
+	if(BatchSize <= 1 && m_RecvBatchPos >= m_RecvBatchNum)
+	{
+		// single packet path
+		m_RecvSyscalls++;
+		int Bytes = net_udp_recv(m_Socket, pAddr, m_RecvUnpacker.m_aBuffer, NET_MAX_PACKETSIZE);
+		if(Bytes > 0)
+			m_RecvPackets++;
+		*ppData = m_RecvUnpacker.m_aBuffer;
+		return Bytes;
+	}
+
+	// refill the batch once all packets from the last one are processed
+	if(m_RecvBatchPos >= m_RecvBatchNum)
+	{
+		int Syscalls = 0;
+		m_RecvBatchPos = 0;
+		m_RecvBatchNum = net_udp_recv_batch(m_Socket, m_aRecvBatchAddr, m_aRecvBatchData, m_aRecvBatchSize, NET_MAX_PACKETSIZE, BatchSize, &Syscalls);
+		m_RecvSyscalls += Syscalls;
+		m_RecvPackets += m_RecvBatchNum;
+		if(m_RecvBatchNum <= 0)
+		{
+			m_RecvBatchNum = 0;
+			return 0;
+		}
+	}
+
+	int Index = m_RecvBatchPos++;
+	*pAddr = m_aRecvBatchAddr[Index];
+	*ppData = &m_aRecvBatchData[Index*NET_MAX_PACKETSIZE];
+	return m_aRecvBatchSize[Index];
+}
+
+int CNetServer::Recv(CNetChunk *pChunk)
+{
+	if(m_Threaded)
+		return RecvThreaded(pChunk);
+	return RecvNet(pChunk);
+}
+
 /*
 	TODO: chopp up this function into smaller working parts
 */
-int CNetServer::Recv(CNetChunk *pChunk)
+int CNetServer::RecvNet(CNetChunk *pChunk)
 {
 	while(1)
 	{
 		NETADDR Addr;
+		unsigned char *pData;
 
 		// check for a chunk
 		if(m_RecvUnpacker.FetchChunk(pChunk))
 			return 1;
 
-		// TODO: empty the recvinfo
-		int Bytes = net_udp_recv(m_Socket, &Addr, m_RecvUnpacker.m_aBuffer, NET_MAX_PACKETSIZE);
+		int Bytes = FetchPacket(&Addr, &pData);
 
 		// no more packets for now
 		if(Bytes <= 0)
@@ -557,7 +691,7 @@ int CNetServer::Recv(CNetChunk *pChunk)
 			continue;
 		} */
 
-		if(CNetBase::UnpackPacket(m_RecvUnpacker.m_aBuffer, Bytes, &m_RecvUnpacker.m_Data) == 0)
+		if(CNetBase::UnpackPacket(pData, Bytes, &m_RecvUnpacker.m_Data) == 0)
 		{
 			if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONNLESS)
 			{
@@ -634,11 +768,18 @@ int CNetServer::Send(CNetChunk *pChunk)
 		return -1;
 	}
 
+	if(m_Threaded)
+		return SendThreaded(pChunk);
+	return SendNet(pChunk);
+}
+
+int CNetServer::SendNet(CNetChunk *pChunk)
+{
 	if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
 	{
 		// send connectionless packet
 		CNetBase::SendPacketConnless(m_Socket, &pChunk->m_Address, pChunk->m_pData, pChunk->m_DataSize,
-				pChunk->m_Flags&NETSENDFLAG_EXTENDED, pChunk->m_aExtraData);
+				pChunk->m_Flags&NETSENDFLAG_EXTENDED, pChunk->m_aExtraData, &m_SendQueue);
 	}
 	else
 	{
@@ -656,7 +797,7 @@ int CNetServer::Send(CNetChunk *pChunk)
 		}
 		else
 		{
-			Drop(pChunk->m_ClientID, "Error sending data");
+			DropNet(pChunk->m_ClientID, "Error sending data");
 		}
 	}
 	return 0;
@@ -0,0 +1,431 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/console.h>
+
+#include "config.h"
+#include "netban.h"
+#include "network.h"
+
+/*
+	The network thread owns the socket and every connection while it runs.
+	It receives, unpacks and acks packets, handles timeouts and resends and
+	flushes the send queue. The game thread only talks to it through two
+	single producer/single consumer queues, so the game logic stays single
+	threaded and sees chunks and client events in the order they arrived.
+
+	Slots get a new generation for every accepted client. Events carry the
+	generation they were created for, which lets both sides ignore events
+	for a client the other side already dropped, even if the slot has been
+	taken by a new client in the meantime.
+*/
+
+void CNetServer::OnNewClient(int Slot, bool NoAuth)
+{
+	if(!m_Threaded)
+	{
+		if(NoAuth)
+			m_pfnNewClientNoAuth(Slot, m_UserPtr);
+		else
+			m_pfnNewClient(Slot, m_UserPtr);
+		return;
+	}
+
+	CNetEvent *pEvent = NewInEvent();
+	pEvent->m_Type = NoAuth ? NETEVENT_NEWCLIENT_NOAUTH : NETEVENT_NEWCLIENT;
+	pEvent->m_ClientID = Slot;
+	pEvent->m_Generation = m_aSlots[Slot].m_Generation;
+	pEvent->m_Flags = m_aSlots[Slot].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED;
+	pEvent->m_Address = *m_aSlots[Slot].m_Connection.PeerAddress();
+	pEvent->m_DataSize = 0;
+	m_pInQueue->Commit();
+}
+
+void CNetServer::OnDelClient(int Slot, const char *pReason)
+{
+	if(!m_Threaded)
+	{
+		if(m_pfnDelClient)
+			m_pfnDelClient(Slot, pReason, m_UserPtr);
+		return;
+	}
+
+	CNetEvent *pEvent = NewInEvent();
+	pEvent->m_Type = NETEVENT_DELCLIENT;
+	pEvent->m_ClientID = Slot;
+	pEvent->m_Generation = m_aSlots[Slot].m_Generation;
+	str_copy((char *)pEvent->m_aData, pReason, sizeof(pEvent->m_aData));
+	pEvent->m_DataSize = str_length((char *)pEvent->m_aData)+1;
+	m_pInQueue->Commit();
+}
+
+void CNetServer::OnClientRejoin(int Slot)
+{
+	if(!m_Threaded)
+	{
+		m_pfnClientRejoin(Slot, m_UserPtr);
+		return;
+	}
+
+	CNetEvent *pEvent = NewInEvent();
+	pEvent->m_Type = NETEVENT_REJOIN;
+	pEvent->m_ClientID = Slot;
+	pEvent->m_Generation = m_aSlots[Slot].m_Generation;
+	pEvent->m_DataSize = 0;
+	m_pInQueue->Commit();
+}
+
+void CNetServer::OnStressBan(int Slot)
+{
+	if(!m_Threaded)
+	{
+		if(NetBan()->BanAddr(ClientAddr(Slot), 60, "Stressing network") == -1)
+			DropNet(Slot, m_aSlots[Slot].m_Connection.ErrorString());
+		return;
+	}
+
+	// bans kick clients, so they have to be issued by the game thread.
+	// drop the slot here in any case, the kick is ignored if it comes late
+	CNetEvent *pEvent = NewInEvent();
+	pEvent->m_Type = NETEVENT_BAN;
+	pEvent->m_ClientID = Slot;
+	pEvent->m_Generation = m_aSlots[Slot].m_Generation;
+	pEvent->m_Address = *m_aSlots[Slot].m_Connection.PeerAddress();
+	pEvent->m_DataSize = 0;
+	m_pInQueue->Commit();
+
+	DropNet(Slot, m_aSlots[Slot].m_Connection.ErrorString());
+}
+
+void CNetServer::GatherStats(CNetStats *pStats)
+{
+	pStats->m_RecvPackets = m_RecvPackets;
+	pStats->m_RecvSyscalls = m_RecvSyscalls;
+	pStats->m_SendPackets = m_SendQueue.Packets();
+	pStats->m_SendSyscalls = m_SendQueue.Syscalls();
+	pStats->m_SendFlushes = m_SendQueue.Flushes();
+	pStats->m_SendFlushTime = m_SendQueue.FlushTime();
+	pStats->m_SendMaxFlushTime = m_SendQueue.MaxFlushTime();
+	m_SendQueue.ResetMaxFlushTime();
+}
+
+CNetServer::CNetEvent *CNetServer::NewInEvent()
+{
+	// the game thread never waits on us while we wait here, as long as
+	// its sends keep being processed
+	CNetEvent *pEvent;
+	while(!(pEvent = m_pInQueue->Produce()))
+	{
+		ProcessOutEvents();
+		thread_yield();
+	}
+	return pEvent;
+}
+
+CNetServer::CNetEvent *CNetServer::NewOutEvent()
+{
+	CNetEvent *pEvent;
+	while(!(pEvent = m_pOutQueue->Produce()))
+		thread_yield();
+	return pEvent;
+}
+
+void CNetServer::ProcessOutEvents()
+{
+	// events are copied out before handling them, handling can end up
+	// in here again while waiting for room in the incoming queue
+	CNetEvent Event;
+	CNetEvent *pEvent;
+	while((pEvent = m_pOutQueue->Peek()))
+	{
+		int HeaderSize = (int)(pEvent->m_aData-(unsigned char *)pEvent);
+		mem_copy(&Event, pEvent, HeaderSize+pEvent->m_DataSize);
+		m_pOutQueue->Pop();
+
+		if(Event.m_Type == NETEVENT_STATS_REQUEST)
+		{
+			CNetEvent *pEvent = NewInEvent();
+			pEvent->m_Type = NETEVENT_STATS;
+			pEvent->m_ClientID = -1;
+			pEvent->m_Generation = 0;
+			GatherStats((CNetStats *)pEvent->m_aData);
+			pEvent->m_DataSize = sizeof(CNetStats);
+			m_pInQueue->Commit();
+			continue;
+		}
+
+		bool Connless = Event.m_Type == NETEVENT_SEND && (Event.m_Flags&NETSENDFLAG_CONNLESS);
+		if(!Connless && (m_aSlots[Event.m_ClientID].m_Generation != Event.m_Generation ||
+			m_aSlots[Event.m_ClientID].m_Connection.State() == NET_CONNSTATE_OFFLINE))
+			continue; // client is gone already
+
+		if(Event.m_Type == NETEVENT_SEND)
+		{
+			CNetChunk Chunk;
+			Chunk.m_ClientID = Event.m_ClientID;
+			Chunk.m_Address = Event.m_Address;
+			Chunk.m_Flags = Event.m_Flags;
+			Chunk.m_DataSize = Event.m_DataSize;
+			Chunk.m_pData = Event.m_aData;
+			mem_copy(Chunk.m_aExtraData, Event.m_aExtraData, sizeof(Chunk.m_aExtraData));
+			SendNet(&Chunk);
+		}
+		else if(Event.m_Type == NETEVENT_DROP)
+		{
+			// the game thread already ran the drop callback
+			m_aSlots[Event.m_ClientID].m_Connection.Disconnect((const char *)Event.m_aData);
+			UnindexSlot(Event.m_ClientID);
+		}
+	}
+}
+
+void CNetServer::PumpRecv()
+{
+	CNetChunk Chunk;
+	for(int i = 0; i < NET_THREAD_QUEUE_SIZE && RecvNet(&Chunk); i++)
+	{
+		CNetEvent *pEvent = NewInEvent();
+		pEvent->m_Type = NETEVENT_CHUNK;
+		pEvent->m_ClientID = Chunk.m_ClientID;
+		pEvent->m_Generation = Chunk.m_ClientID >= 0 ? m_aSlots[Chunk.m_ClientID].m_Generation : 0;
+		pEvent->m_Flags = Chunk.m_Flags;
+		pEvent->m_Address = Chunk.m_Address;
+		pEvent->m_DataSize = Chunk.m_DataSize;
+		mem_copy(pEvent->m_aExtraData, Chunk.m_aExtraData, sizeof(pEvent->m_aExtraData));
+		mem_copy(pEvent->m_aData, Chunk.m_pData, Chunk.m_DataSize);
+		m_pInQueue->Commit();
+	}
+}
+
+void CNetServer::NetThread(void *pUser)
+{
+	CNetServer *pThis = (CNetServer *)pUser;
+
+	while(!pThis->m_StopThread)
+	{
+		pThis->ProcessOutEvents();
+		pThis->UpdateNet();
+		pThis->PumpRecv();
+		pThis->ProcessOutEvents();
+		pThis->m_SendQueue.Flush();
+
+		net_socket_read_wait(pThis->m_Socket, 1);
+	}
+
+	// send out what the game thread queued last
+	pThis->ProcessOutEvents();
+	pThis->m_SendQueue.Flush();
+
+	sync_barrier();
+	pThis->m_ThreadDone = 1;
+}
+
+bool CNetServer::StartThread()
+{
+	if(m_Threaded)
+		return true;
+
+	m_pInQueue = new CNetEventQueue;
+	m_pOutQueue = new CNetEventQueue;
+	m_InEventPending = false;
+	m_StopThread = 0;
+	m_ThreadDone = 0;
+
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		bool Online = m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE;
+		m_aGameGeneration[i] = Online ? m_aSlots[i].m_Generation : -1;
+		m_aGameAddr[i] = *m_aSlots[i].m_Connection.PeerAddress();
+		m_aGameSecurityToken[i] = m_aSlots[i].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED;
+	}
+
+	// everything has to be in place before the thread starts
+	m_Threaded = true;
+	sync_barrier();
+	m_pThread = teethread_create(NetThread, this);
+	if(!m_pThread)
+	{
+		m_Threaded = false;
+		delete m_pInQueue;
+		delete m_pOutQueue;
+		m_pInQueue = 0;
+		m_pOutQueue = 0;
+		return false;
+	}
+	return true;
+}
+
+void CNetServer::StopThread()
+{
+	if(!m_Threaded)
+		return;
+
+	// keep the incoming queue moving, the thread might wait for room in it.
+	// remaining client events are handed to the game, chunks are dropped
+	CNetChunk Chunk;
+	m_StopThread = 1;
+	while(!m_ThreadDone)
+	{
+		while(RecvThreaded(&Chunk))
+			;
+		thread_yield();
+	}
+	thread_wait(m_pThread);
+	while(RecvThreaded(&Chunk))
+		;
+
+	m_Threaded = false;
+	m_pThread = 0;
+	delete m_pInQueue;
+	delete m_pOutQueue;
+	m_pInQueue = 0;
+	m_pOutQueue = 0;
+}
+
+void CNetServer::Wait(int Microseconds)
+{
+	// the network thread is reading the socket, just give it time to do so
+	if(m_Threaded)
+		thread_sleep_us(min(Microseconds, 1000));
+	else
+		net_socket_read_wait_us(m_Socket, Microseconds);
+}
+
+int CNetServer::RecvThreaded(CNetChunk *pChunk)
+{
+	while(1)
+	{
+		// the data of the last returned chunk lives in the queue until now
+		if(m_InEventPending)
+		{
+			m_pInQueue->Pop();
+			m_InEventPending = false;
+		}
+
+		CNetEvent *pEvent = m_pInQueue->Peek();
+		if(!pEvent)
+			return 0;
+
+		int ClientID = pEvent->m_ClientID;
+		bool Current = ClientID >= 0 && m_aGameGeneration[ClientID] == pEvent->m_Generation;
+
+		switch(pEvent->m_Type)
+		{
+		case NETEVENT_CHUNK:
+			if(ClientID >= 0 && !Current)
+				break;
+			pChunk->m_ClientID = ClientID;
+			pChunk->m_Address = pEvent->m_Address;
+			pChunk->m_Flags = pEvent->m_Flags;
+			pChunk->m_DataSize = pEvent->m_DataSize;
+			pChunk->m_pData = pEvent->m_aData;
+			mem_copy(pChunk->m_aExtraData, pEvent->m_aExtraData, sizeof(pChunk->m_aExtraData));
+			m_InEventPending = true;
+			return 1;
+		case NETEVENT_NEWCLIENT:
+		case NETEVENT_NEWCLIENT_NOAUTH:
+			m_aGameGeneration[ClientID] = pEvent->m_Generation;
+			m_aGameAddr[ClientID] = pEvent->m_Address;
+			m_aGameSecurityToken[ClientID] = pEvent->m_Flags != 0;
+			if(pEvent->m_Type == NETEVENT_NEWCLIENT_NOAUTH)
+				m_pfnNewClientNoAuth(ClientID, m_UserPtr);
+			else
+				m_pfnNewClient(ClientID, m_UserPtr);
+			break;
+		case NETEVENT_DELCLIENT:
+			if(!Current)
+				break;
+			m_aGameGeneration[ClientID] = -1;
+			if(m_pfnDelClient)
+				m_pfnDelClient(ClientID, (const char *)pEvent->m_aData, m_UserPtr);
+			break;
+		case NETEVENT_REJOIN:
+			if(Current)
+				m_pfnClientRejoin(ClientID, m_UserPtr);
+			break;
+		case NETEVENT_BAN:
+			if(NetBan())
+				NetBan()->BanAddr(&pEvent->m_Address, 60, "Stressing network");
+			break;
+		case NETEVENT_STATS:
+			mem_copy(&m_GameStats, pEvent->m_aData, sizeof(m_GameStats));
+			m_GameStatsReady = true;
+			break;
+		}
+
+		m_pInQueue->Pop();
+	}
+}
+
+int CNetServer::SendThreaded(CNetChunk *pChunk)
+{
+	int Generation = 0;
+	if(!(pChunk->m_Flags&NETSENDFLAG_CONNLESS))
+	{
+		dbg_assert(pChunk->m_ClientID >= 0, "errornous client id");
+		dbg_assert(pChunk->m_ClientID < MaxClients(), "errornous client id");
+
+		Generation = m_aGameGeneration[pChunk->m_ClientID];
+		if(Generation == -1)
+			return -1;
+	}
+
+	CNetEvent *pEvent = NewOutEvent();
+	pEvent->m_Type = NETEVENT_SEND;
+	pEvent->m_ClientID = pChunk->m_ClientID;
+	pEvent->m_Generation = Generation;
+	pEvent->m_Flags = pChunk->m_Flags;
+	pEvent->m_Address = pChunk->m_Address;
+	pEvent->m_DataSize = pChunk->m_DataSize;
+	mem_copy(pEvent->m_aExtraData, pChunk->m_aExtraData, sizeof(pEvent->m_aExtraData));
+	mem_copy(pEvent->m_aData, pChunk->m_pData, pChunk->m_DataSize);
+	m_pOutQueue->Commit();
+	return 0;
+}
+
+void CNetServer::RequestStats()
+{
+	if(!m_Threaded)
+	{
+		GatherStats(&m_GameStats);
+		m_GameStatsReady = true;
+		return;
+	}
+
+	CNetEvent *pEvent = NewOutEvent();
+	pEvent->m_Type = NETEVENT_STATS_REQUEST;
+	pEvent->m_ClientID = -1;
+	pEvent->m_Generation = 0;
+	pEvent->m_DataSize = 0;
+	m_pOutQueue->Commit();
+}
+
+bool CNetServer::PollStats(CNetStats *pStats)
+{
+	if(!m_GameStatsReady)
+		return false;
+	*pStats = m_GameStats;
+	m_GameStatsReady = false;
+	return true;
+}
+
+int CNetServer::DropThreaded(int ClientID, const char *pReason)
+{
+	if(m_pfnDelClient)
+		m_pfnDelClient(ClientID, pReason, m_UserPtr);
+
+	int Generation = m_aGameGeneration[ClientID];
+	if(Generation == -1)
+		return 0;
+	m_aGameGeneration[ClientID] = -1;
+
+	CNetEvent *pEvent = NewOutEvent();
+	pEvent->m_Type = NETEVENT_DROP;
+	pEvent->m_ClientID = ClientID;
+	pEvent->m_Generation = Generation;
+	str_copy((char *)pEvent->m_aData, pReason, sizeof(pEvent->m_aData));
+	pEvent->m_DataSize = str_length((char *)pEvent->m_aData)+1;
+	m_pOutQueue->Commit();
+	return 0;
+}
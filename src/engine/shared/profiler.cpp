@@ -0,0 +1,68 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/console.h>
+
+#include "profiler.h"
+
+CProfiler g_Profiler;
+
+CProfiler::CProfiler()
+{
+	static const char *s_apNames[NUM_SECTIONS] = {
+		"input",
+		"world 0", "world 1", "world 2", "world 3", "world 4", "world 5", "world 6", "world 7",
+		"controller",
+		"players",
+		"bots",
+		"snap build",
+		"snap delta",
+		"snap compress",
+		"snap send",
+		"network",
+	};
+
+	for(int i = 0; i < NUM_SECTIONS; i++)
+		m_apNames[i] = s_apNames[i];
+	Reset();
+}
+
+void CProfiler::EndTick()
+{
+	for(int i = 0; i < NUM_SECTIONS; i++)
+	{
+		if(!m_aUsed[i])
+			continue;
+
+		m_aHistograms[i].Add((int)(m_aTickTime[i]*1000000/time_freq()));
+		m_aTotalTime[i] += m_aTickTime[i];
+		m_aTickTime[i] = 0;
+		m_aUsed[i] = false;
+	}
+}
+
+void CProfiler::Report(IConsole *pConsole)
+{
+	char aBuf[256];
+	for(int i = 0; i < NUM_SECTIONS; i++)
+	{
+		const CHistogram *pHistogram = &m_aHistograms[i];
+		if(!pHistogram->Num())
+			continue;
+
+		str_format(aBuf, sizeof(aBuf), "%-14s ticks=%-6d avg=%5dus p50=%5dus p99=%5dus max=%5dus", m_apNames[i], pHistogram->Num(),
+			(int)(m_aTotalTime[i]*1000000/time_freq()/pHistogram->Num()),
+			pHistogram->Percentile(50), pHistogram->Percentile(99), pHistogram->Max());
+		pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	}
+}
+
+void CProfiler::Reset()
+{
+	for(int i = 0; i < NUM_SECTIONS; i++)
+	{
+		m_aHistograms[i].Reset();
+		m_aTickTime[i] = 0;
+		m_aTotalTime[i] = 0;
+		m_aUsed[i] = false;
+	}
+}
@@ -0,0 +1,89 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_PROFILER_H
+#define ENGINE_SHARED_PROFILER_H
+
+#include <base/system.h>
+
+#include "config.h"
+#include "histogram.h"
+#include "trace.h"
+
+/*
+	Class: CProfiler
+		Times the phases of a server tick while dbg_pref is set. The time
+		of each section is summed over a tick and counted in a histogram
+		once the tick is done, the perf command prints and resets them.
+*/
+class CProfiler
+{
+public:
+	enum
+	{
+		SECTION_INPUT=0,
+		// one per entity type of the game world, in the same order
+		SECTION_WORLD,
+		SECTION_WORLD_LAST=SECTION_WORLD+7,
+		SECTION_CONTROLLER,
+		SECTION_PLAYERS,
+		SECTION_BOTS,
+		SECTION_SNAP_BUILD,
+		SECTION_SNAP_DELTA,
+		SECTION_SNAP_COMPRESS,
+		SECTION_SNAP_SEND,
+		SECTION_NETWORK,
+		NUM_SECTIONS
+	};
+
+private:
+	CHistogram m_aHistograms[NUM_SECTIONS];
+	int64 m_aTickTime[NUM_SECTIONS];
+	int64 m_aTotalTime[NUM_SECTIONS];
+	bool m_aUsed[NUM_SECTIONS];
+	const char *m_apNames[NUM_SECTIONS];
+
+public:
+	CProfiler();
+
+	static bool Enabled() { return g_Config.m_DbgPref != 0; }
+
+	void SetName(int Section, const char *pName) { m_apNames[Section] = pName; }
+	const char *Name(int Section) const { return m_apNames[Section]; }
+	void Add(int Section, int64 Time)
+	{
+		m_aTickTime[Section] += Time;
+		m_aUsed[Section] = true;
+	}
+
+	// counts the time of the sections used since the last call
+	void EndTick();
+	void Report(class IConsole *pConsole);
+	void Reset();
+};
+
+extern CProfiler g_Profiler;
+
+// adds the time until the end of the scope to a section, and to the
+// trace when it is recorded
+class CProfileScope
+{
+	int m_Section;
+	int m_ClientID;
+	int64 m_Start;
+
+public:
+	CProfileScope(int Section, int ClientID = -1) : m_Section(Section), m_ClientID(ClientID),
+		m_Start(CProfiler::Enabled() || CTrace::Enabled() ? time_get() : 0) {}
+	~CProfileScope()
+	{
+		if(!m_Start)
+			return;
+		int64 End = time_get();
+		if(CProfiler::Enabled())
+			g_Profiler.Add(m_Section, End-m_Start);
+		if(CTrace::Enabled())
+			g_Trace.Add(g_Profiler.Name(m_Section), m_Start, End, m_ClientID);
+	}
+};
+
+#endif
@@ -78,7 +78,8 @@ enum
 	SERVER_TICK_SPEED=50,
 	SERVER_FLAG_PASSWORD = 0x1,
 
-	MAX_CLIENTS=64,
+	MAX_CLIENTS=128,
+	LEGACY_MAX_CLIENTS=64,
 	VANILLA_MAX_CLIENTS=16,
 
 	MAX_INPUT_SIZE=128,
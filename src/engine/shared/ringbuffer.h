@@ -3,6 +3,8 @@
 #ifndef ENGINE_SHARED_RINGBUFFER_H
 #define ENGINE_SHARED_RINGBUFFER_H
 
+#include <base/tl/threading.h>
+
 typedef struct RINGBUFFER RINGBUFFER;
 
 class CRingBufferBase
@@ -65,4 +67,25 @@ public:
 	T *Last() { return (T*)CRingBufferBase::Last(); }
 };
 
+// lock free ring for exactly one producing and one consuming thread, TSIZE must be a power of two
+template<typename T, int TSIZE>
+class TSpscRingBuffer
+{
+	T m_aItems[TSIZE];
+	volatile unsigned m_Consume;
+	volatile unsigned m_Produce;
+public:
+	TSpscRingBuffer() { m_Consume = 0; m_Produce = 0; }
+
+	// producer side, the item becomes visible to the consumer on Commit
+	T *Produce() { return m_Produce-m_Consume < (unsigned)TSIZE ? &m_aItems[m_Produce&(TSIZE-1)] : 0; }
+	void Commit() { sync_barrier(); m_Produce = m_Produce+1; }
+
+	// consumer side, the item stays valid until Pop
+	T *Peek() { if(m_Consume == m_Produce) return 0; sync_barrier(); return &m_aItems[m_Consume&(TSIZE-1)]; }
+	void Pop() { sync_barrier(); m_Consume = m_Consume+1; }
+
+	bool Empty() const { return m_Consume == m_Produce; }
+};
+
 #endif
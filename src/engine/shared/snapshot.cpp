@@ -1,5 +1,11 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "snapshot.h"
 #include "compression.h"
 
@@ -101,7 +107,7 @@ static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
 	return -1;
 }
 
-static int DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
+static int DiffItemReference(int *pPast, int *pCurrent, int *pOut, int Size)
 {
 	int Needed = 0;
 	while(Size)
@@ -117,6 +123,99 @@ static int DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
 	return Needed;
 }
 
+/*
+	Class: CItemIndex
+		Open addressed key to item index map of a snapshot. Unlike the
+		hash list above it has room for every item, so no key gets lost.
+*/
+class CItemIndex
+{
+	enum
+	{
+		// twice CSnapshotBuilder::MAX_ITEMS, power of two
+		MAX_SLOTS=2048,
+	};
+
+	int m_aKeys[MAX_SLOTS];
+	short m_aIndex[MAX_SLOTS];
+	unsigned m_Mask;
+	int m_Shift;
+
+	unsigned Hash(int Key) const { return ((unsigned)Key*0x9E3779B1u)>>m_Shift; }
+
+public:
+	void Build(CSnapshot *pSnapshot)
+	{
+		// keep the load factor at or below one half
+		int NumItems = min(pSnapshot->NumItems(), MAX_SLOTS/2);
+		int Bits = 4;
+		while((1<<Bits) < NumItems*2)
+			Bits++;
+		m_Mask = (1<<Bits)-1;
+		m_Shift = 32-Bits;
+		mem_zero(m_aIndex, (m_Mask+1)*sizeof(short));
+
+		// indices are stored plus one, the first item wins for duplicate keys
+		for(int i = 0; i < NumItems; i++)
+		{
+			int Key = pSnapshot->GetItem(i)->Key();
+			unsigned Slot = Hash(Key);
+			while(m_aIndex[Slot] && m_aKeys[Slot] != Key)
+				Slot = (Slot+1)&m_Mask;
+			if(!m_aIndex[Slot])
+			{
+				m_aKeys[Slot] = Key;
+				m_aIndex[Slot] = i+1;
+			}
+		}
+	}
+
+	int Find(int Key) const
+	{
+		for(unsigned Slot = Hash(Key); m_aIndex[Slot]; Slot = (Slot+1)&m_Mask)
+		{
+			if(m_aKeys[Slot] == Key)
+				return m_aIndex[Slot]-1;
+		}
+		return -1;
+	}
+};
+
+// returns 0 without touching pOut if the item didn't change
+static int DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	int i = 0;
+
+	// most items are unchanged, so check that before diffing
+#if defined(__SSE2__)
+	for(; i+4 <= Size; i += 4)
+	{
+		__m128i Past = _mm_loadu_si128((const __m128i *)(pPast+i));
+		__m128i Current = _mm_loadu_si128((const __m128i *)(pCurrent+i));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(Past, Current)) != 0xffff)
+			break;
+	}
+#endif
+	while(i < Size && pPast[i] == pCurrent[i])
+		i++;
+	if(i == Size)
+		return 0;
+
+	i = 0;
+#if defined(__SSE2__)
+	for(; i+4 <= Size; i += 4)
+	{
+		__m128i Past = _mm_loadu_si128((const __m128i *)(pPast+i));
+		__m128i Current = _mm_loadu_si128((const __m128i *)(pCurrent+i));
+		_mm_storeu_si128((__m128i *)(pOut+i), _mm_sub_epi32(Current, Past));
+	}
+#endif
+	for(; i < Size; i++)
+		pOut[i] = pCurrent[i]-pPast[i];
+
+	return 1;
+}
+
 void CSnapshotDelta::UndiffItem(int *pPast, int *pDiff, int *pOut, int Size)
 {
 	while(Size)
@@ -150,7 +249,8 @@ CSnapshotDelta::CSnapshotDelta()
 
 void CSnapshotDelta::SetStaticsize(int ItemType, int Size)
 {
-	m_aItemSizes[ItemType] = Size;
+	if(ItemType >= 0 && ItemType < MAX_STATICSIZES)
+		m_aItemSizes[ItemType] = Size;
 }
 
 CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta()
@@ -158,8 +258,68 @@ CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta()
 	return &m_Empty;
 }
 
-// TODO: OPT: this should be made much faster
 int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
+{
+	CData *pDelta = (CData *)pDstData;
+	int *pData = (int *)pDelta->m_pData;
+
+	pDelta->m_NumDeletedItems = 0;
+	pDelta->m_NumUpdateItems = 0;
+	pDelta->m_NumTempItems = 0;
+
+	CItemIndex ToIndex;
+	ToIndex.Build(pTo);
+
+	// pack deleted stuff
+	const int NumFromItems = pFrom->NumItems();
+	for(int i = 0; i < NumFromItems; i++)
+	{
+		int Key = pFrom->GetItem(i)->Key();
+		if(ToIndex.Find(Key) == -1)
+		{
+			// deleted
+			pDelta->m_NumDeletedItems++;
+			*pData++ = Key;
+		}
+	}
+
+	CItemIndex FromIndex;
+	FromIndex.Build(pFrom);
+
+	const int NumItems = pTo->NumItems();
+	for(int i = 0; i < NumItems; i++)
+	{
+		int ItemSize = pTo->GetItemSize(i);
+		CSnapshotItem *pCurItem = pTo->GetItem(i);
+		int Type = pCurItem->Type();
+		int PastIndex = FromIndex.Find(pCurItem->Key());
+		int *pItemDataDst = StaticSize(Type) ? pData+2 : pData+3;
+
+		if(PastIndex != -1)
+		{
+			// unchanged items leave pData untouched
+			if(!DiffItem((int *)pFrom->GetItem(PastIndex)->Data(), (int *)pCurItem->Data(), pItemDataDst, ItemSize/4))
+				continue;
+		}
+		else
+			mem_copy(pItemDataDst, pCurItem->Data(), ItemSize);
+
+		*pData++ = Type;
+		*pData++ = pCurItem->ID();
+		if(!StaticSize(Type))
+			*pData++ = ItemSize/4;
+		pData += ItemSize/4;
+		pDelta->m_NumUpdateItems++;
+	}
+
+	if(!pDelta->m_NumDeletedItems && !pDelta->m_NumUpdateItems && !pDelta->m_NumTempItems)
+		return 0;
+
+	return (int)((char*)pData-(char*)pDstData);
+}
+
+// the original implementation, kept to verify CreateDelta against it
+int CSnapshotDelta::CreateDeltaReference(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
 {
 	CData *pDelta = (CData *)pDstData;
 	int *pData = (int *)pDelta->m_pData;
@@ -215,15 +375,15 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 
 			pPastItem = pFrom->GetItem(PastIndex);
 
-			if(m_aItemSizes[pCurItem->Type()])
+			if(StaticSize(pCurItem->Type()))
 				pItemDataDst = pData+2;
 
-			if(DiffItem((int*)pPastItem->Data(), (int*)pCurItem->Data(), pItemDataDst, ItemSize/4))
+			if(DiffItemReference((int*)pPastItem->Data(), (int*)pCurItem->Data(), pItemDataDst, ItemSize/4))
 			{
 
 				*pData++ = pCurItem->Type();
 				*pData++ = pCurItem->ID();
-				if(!m_aItemSizes[pCurItem->Type()])
+				if(!StaticSize(pCurItem->Type()))
 					*pData++ = ItemSize/4;
 				pData += ItemSize/4;
 				pDelta->m_NumUpdateItems++;
@@ -233,7 +393,7 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 		{
 			*pData++ = pCurItem->Type();
 			*pData++ = pCurItem->ID();
-			if(!m_aItemSizes[pCurItem->Type()])
+			if(!StaticSize(pCurItem->Type()))
 				*pData++ = ItemSize/4;
 
 			mem_copy(pData, pCurItem->Data(), ItemSize);
@@ -331,8 +491,10 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 
 		Type = *pData++;
 		ID = *pData++;
-		if(m_aItemSizes[Type])
-			ItemSize = m_aItemSizes[Type];
+		if(Type < 0 || Type > 0xffff)
+			return -3;
+		if(StaticSize(Type))
+			ItemSize = StaticSize(Type);
 		else
 		{
 			if(pData+1 > pEnd)
@@ -376,113 +538,176 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 
 // CSnapshotStorage
 
+CSnapshotStorage::CSnapshotStorage()
+{
+	m_pArena = 0;
+	m_ArenaSize = 0;
+	Init();
+}
+
+CSnapshotStorage::~CSnapshotStorage()
+{
+	if(m_pArena)
+		mem_free(m_pArena);
+}
+
 void CSnapshotStorage::Init()
 {
-	m_pFirst = 0;
-	m_pLast = 0;
+	for(int i = 0; i < NUM_SLOTS; i++)
+		m_aSlots[i].m_Tick = -1;
+	m_FirstTick = 0;
+	m_LastTick = 0;
+	m_NumSnaps = 0;
 }
 
 void CSnapshotStorage::PurgeAll()
 {
-	CHolder *pHolder = m_pFirst;
-	CHolder *pNext;
-
-	while(pHolder)
-	{
-		pNext = pHolder->m_pNext;
-		mem_free(pHolder);
-		pHolder = pNext;
-	}
+	// the arena is kept for the next client using this storage
+	Init();
+}
 
-	// no more snapshots in storage
-	m_pFirst = 0;
-	m_pLast = 0;
+void CSnapshotStorage::PopFirst()
+{
+	Slot(m_FirstTick)->m_Tick = -1;
+	if(--m_NumSnaps == 0)
+		return;
+
+	// skip the ticks that weren't snapped
+	do
+		m_FirstTick++;
+	while(Slot(m_FirstTick)->m_Tick != m_FirstTick);
 }
 
 void CSnapshotStorage::PurgeUntil(int Tick)
 {
-	CHolder *pHolder = m_pFirst;
-	CHolder *pNext;
+	while(m_NumSnaps && m_FirstTick < Tick)
+		PopFirst();
+}
+
+int CSnapshotStorage::MemoryUsed() const
+{
+	if(!m_NumSnaps)
+		return 0;
 
-	while(pHolder)
+	const CHolder *pFirst = &m_aSlots[m_FirstTick&(NUM_SLOTS-1)];
+	const CHolder *pLast = &m_aSlots[m_LastTick&(NUM_SLOTS-1)];
+	int End = pLast->m_Offset+pLast->m_BlockSize;
+	if(pLast->m_Offset >= pFirst->m_Offset)
+		return End - pFirst->m_Offset;
+	return m_ArenaSize - pFirst->m_Offset + End;
+}
+
+void CSnapshotStorage::Grow(int Size)
+{
+	int NewSize = max(m_ArenaSize, (int)MIN_ARENA_SIZE);
+	while(NewSize < MemoryUsed()+Size)
+		NewSize *= 2;
+	if(NewSize == m_ArenaSize)
+		NewSize *= 2;
+
+	// move the stored snapshots to the start of the new arena
+	char *pNewArena = (char *)mem_alloc(NewSize, 1);
+	int Used = 0;
+	for(int Tick = m_FirstTick; m_NumSnaps && Tick <= m_LastTick; Tick++)
 	{
-		pNext = pHolder->m_pNext;
-		if(pHolder->m_Tick >= Tick)
-			return; // no more to remove
-		mem_free(pHolder);
+		CHolder *pHolder = Slot(Tick);
+		if(pHolder->m_Tick != Tick)
+			continue;
+
+		mem_copy(pNewArena+Used, m_pArena+pHolder->m_Offset, pHolder->m_BlockSize);
+		if(pHolder->m_AltOffset >= 0)
+			pHolder->m_AltOffset += Used-pHolder->m_Offset;
+		pHolder->m_Offset = Used;
+		Used += pHolder->m_BlockSize;
+	}
 
-		// did we come to the end of the list?
-		if (!pNext)
-			break;
+	if(m_pArena)
+		mem_free(m_pArena);
+	m_pArena = pNewArena;
+	m_ArenaSize = NewSize;
+}
+
+int CSnapshotStorage::Allocate(int Size)
+{
+	if(!m_NumSnaps)
+	{
+		if(Size > m_ArenaSize)
+			Grow(Size);
+		return 0;
+	}
 
-		m_pFirst = pNext;
-		pNext->m_pPrev = 0x0;
+	const CHolder *pFirst = Slot(m_FirstTick);
+	const CHolder *pLast = Slot(m_LastTick);
+	int Start = pFirst->m_Offset;
+	int End = pLast->m_Offset+pLast->m_BlockSize;
 
-		pHolder = pNext;
+	if(pLast->m_Offset >= Start)
+	{
+		// free space is behind the last snapshot and in front of the first one
+		if(End+Size <= m_ArenaSize)
+			return End;
+		if(Size <= Start)
+			return 0;
 	}
+	else if(End+Size <= Start)
+		return End;
 
-	// no more snapshots in storage
-	m_pFirst = 0;
-	m_pLast = 0;
+	Grow(Size);
+	return MemoryUsed();
 }
 
 void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt)
 {
-	// allocate memory for holder + snapshot_data
-	int TotalSize = sizeof(CHolder)+DataSize;
-
-	if(CreateAlt)
-		TotalSize += DataSize;
+	// snapshots have to be added in tick order, and the slot table only holds
+	// NUM_SLOTS ticks, which only drops snapshots when the storage isn't purged
+	if(m_NumSnaps && Tick <= m_LastTick)
+		PurgeAll();
+	PurgeUntil(Tick-NUM_SLOTS+1);
 
-	CHolder *pHolder = (CHolder *)mem_alloc(TotalSize, 1);
+	// keep the snapshots int aligned
+	int AlignedSize = (DataSize+3)&~3;
+	int BlockSize = CreateAlt ? AlignedSize*2 : AlignedSize;
+	int Offset = Allocate(BlockSize);
 
 	// set data
+	CHolder *pHolder = Slot(Tick);
 	pHolder->m_Tick = Tick;
 	pHolder->m_Tagtime = Tagtime;
 	pHolder->m_SnapSize = DataSize;
-	pHolder->m_pSnap = (CSnapshot*)(pHolder+1);
-	mem_copy(pHolder->m_pSnap, pData, DataSize);
+	pHolder->m_Offset = Offset;
+	pHolder->m_BlockSize = BlockSize;
+	mem_copy(m_pArena+Offset, pData, DataSize);
 
 	if(CreateAlt) // create alternative if wanted
 	{
-		pHolder->m_pAltSnap = (CSnapshot*)(((char *)pHolder->m_pSnap) + DataSize);
-		mem_copy(pHolder->m_pAltSnap, pData, DataSize);
+		pHolder->m_AltOffset = Offset+AlignedSize;
+		mem_copy(m_pArena+pHolder->m_AltOffset, pData, DataSize);
 	}
 	else
-		pHolder->m_pAltSnap = 0;
-
+		pHolder->m_AltOffset = -1;
 
-	// link
-	pHolder->m_pNext = 0;
-	pHolder->m_pPrev = m_pLast;
-	if(m_pLast)
-		m_pLast->m_pNext = pHolder;
-	else
-		m_pFirst = pHolder;
-	m_pLast = pHolder;
+	if(!m_NumSnaps)
+		m_FirstTick = Tick;
+	m_LastTick = Tick;
+	m_NumSnaps++;
 }
 
 int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData)
 {
-	CHolder *pHolder = m_pFirst;
-
-	while(pHolder)
-	{
-		if(pHolder->m_Tick == Tick)
-		{
-			if(pTagtime)
-				*pTagtime = pHolder->m_Tagtime;
-			if(ppData)
-				*ppData = pHolder->m_pSnap;
-			if(ppAltData)
-				*ppAltData = pHolder->m_pAltSnap;
-			return pHolder->m_SnapSize;
-		}
+	if(!m_NumSnaps || Tick < m_FirstTick || Tick > m_LastTick)
+		return -1;
 
-		pHolder = pHolder->m_pNext;
-	}
+	CHolder *pHolder = Slot(Tick);
+	if(pHolder->m_Tick != Tick)
+		return -1;
 
-	return -1;
+	if(pTagtime)
+		*pTagtime = pHolder->m_Tagtime;
+	if(ppData)
+		*ppData = (CSnapshot *)(m_pArena+pHolder->m_Offset);
+	if(ppAltData)
+		*ppAltData = pHolder->m_AltOffset >= 0 ? (CSnapshot *)(m_pArena+pHolder->m_AltOffset) : 0;
+	return pHolder->m_SnapSize;
 }
 
 // CSnapshotBuilder
@@ -498,6 +723,13 @@ CSnapshotItem *CSnapshotBuilder::GetItem(int Index)
 	return (CSnapshotItem *)&(m_aData[m_aOffsets[Index]]);
 }
 
+int CSnapshotBuilder::GetItemSize(int Index)
+{
+	if(Index == m_NumItems-1)
+		return (m_DataSize - m_aOffsets[Index]) - sizeof(CSnapshotItem);
+	return (m_aOffsets[Index+1] - m_aOffsets[Index]) - sizeof(CSnapshotItem);
+}
+
 int *CSnapshotBuilder::GetItemData(int Key)
 {
 	int i;
@@ -60,14 +60,20 @@ public:
 	};
 
 private:
-	// TODO: strange arbitrary number
-	short m_aItemSizes[64];
+	enum
+	{
+		// TODO: strange arbitrary number
+		MAX_STATICSIZES=64,
+	};
+
+	short m_aItemSizes[MAX_STATICSIZES];
 	int m_aSnapshotDataRate[0xffff];
 	int m_aSnapshotDataUpdates[0xffff];
 	int m_SnapshotCurrent;
 	CData m_Empty;
 
 	void UndiffItem(int *pPast, int *pDiff, int *pOut, int Size);
+	int StaticSize(int Type) const { return Type >= 0 && Type < MAX_STATICSIZES ? m_aItemSizes[Type] : 0; }
 
 public:
 	CSnapshotDelta();
@@ -76,6 +82,7 @@ public:
 	void SetStaticsize(int ItemType, int Size);
 	CData *EmptyDelta();
 	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
+	int CreateDeltaReference(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
 	int UnpackDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, int DataSize);
 };
 
@@ -85,29 +92,53 @@ public:
 class CSnapshotStorage
 {
 public:
+	enum
+	{
+		// must cover the purge window, power of two
+		NUM_SLOTS=256,
+		MIN_ARENA_SIZE=64*1024,
+	};
+
 	class CHolder
 	{
 	public:
-		CHolder *m_pPrev;
-		CHolder *m_pNext;
-
 		int64 m_Tagtime;
 		int m_Tick;
 
 		int m_SnapSize;
-		CSnapshot *m_pSnap;
-		CSnapshot *m_pAltSnap;
+		int m_Offset;
+		int m_AltOffset;
+		int m_BlockSize;
 	};
 
+private:
+	// snapshots live back to back in a ring arena, in tick order
+	CHolder m_aSlots[NUM_SLOTS];
+	char *m_pArena;
+	int m_ArenaSize;
+
+	int m_FirstTick;
+	int m_LastTick;
+	int m_NumSnaps;
+
+	CHolder *Slot(int Tick) { return &m_aSlots[Tick&(NUM_SLOTS-1)]; }
+	int Allocate(int Size);
+	void Grow(int Size);
+	void PopFirst();
 
-	CHolder *m_pFirst;
-	CHolder *m_pLast;
+public:
+	CSnapshotStorage();
+	~CSnapshotStorage();
 
 	void Init();
 	void PurgeAll();
 	void PurgeUntil(int Tick);
 	void Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt);
 	int Get(int Tick, int64 *Tagtime, CSnapshot **pData, CSnapshot **ppAltData);
+
+	int NumSnapshots() const { return m_NumSnaps; }
+	int MemoryUsed() const;
+	int MemoryAllocated() const { return m_ArenaSize; }
 };
 
 class CSnapshotBuilder
@@ -129,7 +160,9 @@ public:
 	void *NewItem(int Type, int ID, int Size);
 
 	CSnapshotItem *GetItem(int Index);
+	int GetItemSize(int Index);
 	int *GetItemData(int Key);
+	int NumItems() const { return m_NumItems; }
 
 	int Finish(void *Snapdata);
 };
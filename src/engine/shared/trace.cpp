@@ -0,0 +1,54 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include "trace.h"
+
+CTrace g_Trace;
+
+CTrace::CTrace()
+{
+	Clear();
+}
+
+int CTrace::Write(IOHANDLE File)
+{
+	unsigned NumEvents = m_NumEvents;
+	int Count = m_Full ? (int)MAX_EVENTS : (int)NumEvents;
+	unsigned First = m_Full ? NumEvents : 0;
+
+	// the events are added when they end, a parent can start before the first
+	int64 Base = 0;
+	for(int i = 0; i < Count; i++)
+	{
+		const CEvent *pEvent = &m_aEvents[(First+i)%MAX_EVENTS];
+		if(i == 0 || pEvent->m_Start < Base)
+			Base = pEvent->m_Start;
+	}
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "{\"traceEvents\":[\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"main\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"jobs\"}}", THREAD_MAIN, THREAD_JOBS);
+	io_write(File, aBuf, str_length(aBuf));
+
+	double Scale = 1000000.0/time_freq();
+	for(int i = 0; i < Count; i++)
+	{
+		const CEvent *pEvent = &m_aEvents[(First+i)%MAX_EVENTS];
+		if(pEvent->m_ClientID >= 0)
+			str_format(aBuf, sizeof(aBuf), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cid\":%d}}",
+				pEvent->m_pName, pEvent->m_Thread, (pEvent->m_Start-Base)*Scale, (pEvent->m_End-pEvent->m_Start)*Scale, pEvent->m_ClientID);
+		else
+			str_format(aBuf, sizeof(aBuf), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				pEvent->m_pName, pEvent->m_Thread, (pEvent->m_Start-Base)*Scale, (pEvent->m_End-pEvent->m_Start)*Scale);
+		io_write(File, aBuf, str_length(aBuf));
+	}
+
+	io_write(File, "\n]}\n", 4);
+	return Count;
+}
+
+void CTrace::Clear()
+{
+	m_NumEvents = 0;
+	m_Full = false;
+}
@@ -0,0 +1,86 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_TRACE_H
+#define ENGINE_SHARED_TRACE_H
+
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include "config.h"
+
+/*
+	Class: CTrace
+		Records the start and end of the tick phases into a ring buffer
+		while dbg_trace is set, so single slow ticks can be looked at.
+		The slots are taken with an atomic increment, the jobs of other
+		threads can add events without a lock. Write dumps the buffer in
+		the Chrome trace event format.
+*/
+class CTrace
+{
+public:
+	enum
+	{
+		MAX_EVENTS=1<<16,
+
+		THREAD_MAIN=0,
+		THREAD_JOBS,
+	};
+
+private:
+	struct CEvent
+	{
+		int64 m_Start;
+		int64 m_End;
+		const char *m_pName;
+		int m_Thread;
+		int m_ClientID;
+	};
+
+	CEvent m_aEvents[MAX_EVENTS];
+	volatile unsigned m_NumEvents;
+	bool m_Full;
+
+public:
+	CTrace();
+
+	static bool Enabled() { return g_Config.m_DbgTrace != 0; }
+
+	// pName must stay valid, only the pointer is kept
+	void Add(const char *pName, int64 Start, int64 End, int ClientID = -1, int Thread = THREAD_MAIN)
+	{
+		unsigned Index = atomic_inc(&m_NumEvents)-1;
+		CEvent *pEvent = &m_aEvents[Index%MAX_EVENTS];
+		pEvent->m_Start = Start;
+		pEvent->m_End = End;
+		pEvent->m_pName = pName;
+		pEvent->m_Thread = Thread;
+		pEvent->m_ClientID = ClientID;
+		if(Index == MAX_EVENTS-1)
+			m_Full = true;
+	}
+
+	// must not run while events are added, returns the number of events written
+	int Write(IOHANDLE File);
+	void Clear();
+};
+
+extern CTrace g_Trace;
+
+// records the time until the end of the scope
+class CTraceScope
+{
+	const char *m_pName;
+	int m_ClientID;
+	int64 m_Start;
+
+public:
+	CTraceScope(const char *pName, int ClientID = -1) : m_pName(pName), m_ClientID(ClientID), m_Start(CTrace::Enabled() ? time_get() : 0) {}
+	~CTraceScope()
+	{
+		if(m_Start)
+			g_Trace.Add(m_pName, m_Start, time_get(), m_ClientID);
+	}
+};
+
+#endif
@@ -18,6 +18,17 @@ CCollision::CCollision()
 	m_Width = 0;
 	m_Height = 0;
 	m_pLayers = 0;
+	m_pFlagData = 0;
+	m_pIndexData = 0;
+	m_pTriggerData = 0;
+	m_pFlags = 0;
+	m_pIndices = 0;
+	m_pTriggers = 0;
+	m_PaddedWidth = 0;
+	m_PaddedHeight = 0;
+	m_MoveTraceIndex = 0;
+	m_MoveTracesFull = false;
+	m_RecordMoves = false;
 	for (int i = 0; i < 4; i++)
 	{
 		m_telePositions[i].x = 0;
@@ -26,15 +37,135 @@ CCollision::CCollision()
 	}
 }
 
+CCollision::~CCollision()
+{
+	if(m_pFlagData)
+		mem_free(m_pFlagData);
+	if(m_pIndexData)
+		mem_free(m_pIndexData);
+	if(m_pTriggerData)
+		mem_free(m_pTriggerData);
+}
+
+int CCollision::TileFlags(int Index)
+{
+	switch(Index)
+	{
+	case TILE_DEATH: return COLFLAG_DEATH;
+	case TILE_SOLID: return COLFLAG_SOLID;
+	case TILE_NOHOOK: return COLFLAG_SOLID|COLFLAG_NOHOOK;
+	case TILE_FREEZE: case TILE_FREEZE+2: return COLFLAG_FREEZE;
+	case TILE_SLOWDEATH: return COLFLAG_SLOWDEATH;
+	case TILE_HEALTHZONE: case TILE_ARMORZONE: return COLFLAG_ZONE;
+	default: return 0;
+	}
+}
+
+int CCollision::TileTriggers(int Index)
+{
+	switch(Index)
+	{
+	case TILE_DEATH: return TRIGGER_DEATH;
+	case TILE_FREEZE: return TRIGGER_FREEZE;
+	case TILE_FREEZE+2: return TRIGGER_UNFREEZE;
+	case TILE_SLOWDEATH: return TRIGGER_SLOWDEATH;
+	case TILE_HEALTHZONE: return TRIGGER_HEALTHZONE;
+	case TILE_ARMORZONE: return TRIGGER_ARMORZONE;
+	case TILE_SPEEDUPFAST: return TRIGGER_SPEEDUP;
+	case TILE_NOFLAG: return TRIGGER_NOFLAG;
+	default: return 0;
+	}
+}
+
 void CCollision::Init(class CLayers *pLayers)
 {
 	m_pLayers = pLayers;
 	m_Width = m_pLayers->GameLayer()->m_Width;
 	m_Height = m_pLayers->GameLayer()->m_Height;
 	m_pTiles = static_cast<CTile *>(m_pLayers->Map()->GetData(m_pLayers->GameLayer()->m_Data));
+
+	// build the flag and index arrays, the border repeats the outermost tiles
+	m_PaddedWidth = m_Width+BORDER*2;
+	m_PaddedHeight = m_Height+BORDER*2;
+	if(m_pFlagData)
+		mem_free(m_pFlagData);
+	if(m_pIndexData)
+		mem_free(m_pIndexData);
+	if(m_pTriggerData)
+		mem_free(m_pTriggerData);
+	m_pFlagData = (unsigned char *)mem_alloc(m_PaddedWidth*m_PaddedHeight, 1);
+	m_pIndexData = (unsigned char *)mem_alloc(m_PaddedWidth*m_PaddedHeight, 1);
+	m_pTriggerData = (unsigned char *)mem_alloc(m_PaddedWidth*m_PaddedHeight, 1);
+	m_pFlags = m_pFlagData+BORDER*m_PaddedWidth+BORDER;
+	m_pIndices = m_pIndexData+BORDER*m_PaddedWidth+BORDER;
+	m_pTriggers = m_pTriggerData+BORDER*m_PaddedWidth+BORDER;
+
+	for(int y = -BORDER; y < m_Height+BORDER; y++)
+		for(int x = -BORDER; x < m_Width+BORDER; x++)
+		{
+			int Index = m_pTiles[clamp(y, 0, m_Height-1)*m_Width+clamp(x, 0, m_Width-1)].m_Index;
+			m_pFlags[y*m_PaddedWidth+x] = TileFlags(Index);
+			m_pIndices[y*m_PaddedWidth+x] = Index;
+			m_pTriggers[y*m_PaddedWidth+x] = TileTriggers(Index);
+		}
+
+	// mark the tiles next to solid ones, positions in unmarked tiles
+	// can't round into a solid tile
+	for(int y = -BORDER; y < m_Height+BORDER; y++)
+		for(int x = -BORDER; x < m_Width+BORDER; x++)
+		{
+			for(int Ny = max(y-1, -BORDER); Ny <= min(y+1, m_Height+BORDER-1); Ny++)
+				for(int Nx = max(x-1, -BORDER); Nx <= min(x+1, m_Width+BORDER-1); Nx++)
+					if(m_pFlags[Ny*m_PaddedWidth+Nx]&COLFLAG_SOLID)
+						m_pFlags[y*m_PaddedWidth+x] |= COLFLAG_NEARSOLID;
+		}
+}
+
+void CCollision::TakeOver(CCollision *pOther, CLayers *pLayers)
+{
+	if(m_pFlagData)
+		mem_free(m_pFlagData);
+	if(m_pIndexData)
+		mem_free(m_pIndexData);
+	if(m_pTriggerData)
+		mem_free(m_pTriggerData);
+
+	m_pLayers = pLayers;
+	m_pTiles = pOther->m_pTiles;
+	m_Width = pOther->m_Width;
+	m_Height = pOther->m_Height;
+	m_pFlagData = pOther->m_pFlagData;
+	m_pIndexData = pOther->m_pIndexData;
+	m_pTriggerData = pOther->m_pTriggerData;
+	m_pFlags = pOther->m_pFlags;
+	m_pIndices = pOther->m_pIndices;
+	m_pTriggers = pOther->m_pTriggers;
+	m_PaddedWidth = pOther->m_PaddedWidth;
+	m_PaddedHeight = pOther->m_PaddedHeight;
+
+	pOther->m_pFlagData = 0;
+	pOther->m_pIndexData = 0;
+	pOther->m_pTriggerData = 0;
 }
 
-int CCollision::GetTile(int x, int y)
+// the triggers of the tiles under the four corners of a box with the
+// given half size, the same tiles four GetCollisionAt calls would check
+int CCollision::GetTriggers(vec2 Pos, float Offset)
+{
+	int x0 = roundbyteeworlds(Pos.x-Offset);
+	int y0 = roundbyteeworlds(Pos.y-Offset);
+	int x1 = roundbyteeworlds(Pos.x+Offset);
+	int y1 = roundbyteeworlds(Pos.y+Offset);
+
+	int Offset0 = TileOffset(x0, y0);
+	int Offset1 = TileOffset(x1, y1);
+	if(Offset0 == Offset1)
+		return m_pTriggers[Offset0];
+	return m_pTriggers[Offset0]|m_pTriggers[Offset1]|m_pTriggers[TileOffset(x1, y0)]|m_pTriggers[TileOffset(x0, y1)];
+}
+
+// the lookup as it was before the flag array, for the benchmark
+int CCollision::GetTileReference(int x, int y)
 {
 	int Nx = clamp(x/32, 0, m_Width-1);
 	int Ny = clamp(y/32, 0, m_Height-1);
@@ -54,24 +185,90 @@ int CCollision::GetTile(int x, int y)
 	default:
 		return 0;
 	}
-	// return m_pTiles[Ny*m_Width+Nx].m_Index > 128 ? 0 : m_pTiles[Ny*m_Width+Nx].m_Index;
 }
 
-int CCollision::GetTileNew(int x, int y)
+int CCollision::IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
 {
-	int Nx = clamp(x/32, 0, m_Width-1);
-	int Ny = clamp(y/32, 0, m_Height-1);
+	float Distance = distance(Pos0, Pos1);
 
-	return m_pTiles[Ny*m_Width+Nx].m_Index;
-}
+	// short lines aren't worth the traversal, far away ones could overflow the tile coordinates
+	if(!(Distance >= 64.0f) || !(max(absolute(Pos0.x), absolute(Pos0.y)) < 1000000.0f) || !(max(absolute(Pos1.x), absolute(Pos1.y)) < 1000000.0f))
+		return IntersectLineReference(Pos0, Pos1, pOutCollision, pOutBeforeCollision);
 
-bool CCollision::IsTileSolid(int x, int y)
-{
-	return GetTile(x, y)&COLFLAG_SOLID;
+	// the line is tested at the points i/Distance along it, like the
+	// reference does. the tiles the line crosses are walked through
+	// and only the points in tiles next to solid ones get tested
+	int End(Distance+1);
+	vec2 Dir = Pos1-Pos0;
+	int StepX = Dir.x > 0 ? 1 : -1;
+	int StepY = Dir.y > 0 ? 1 : -1;
+	float DeltaX = Dir.x != 0 ? absolute(32.0f/Dir.x) : 1e9f;
+	float DeltaY = Dir.y != 0 ? absolute(32.0f/Dir.y) : 1e9f;
+
+	int i = 0;
+	while(i < End)
+	{
+		// walk the tiles from point i on until one is next to a solid tile
+		vec2 Start = mix(Pos0, Pos1, i/Distance);
+		int TileX = (int)floorf(Start.x/32.0f);
+		int TileY = (int)floorf(Start.y/32.0f);
+		float T = i/Distance;
+		float MaxX = Dir.x != 0 ? ((TileX+(StepX > 0 ? 1 : 0))*32.0f-Pos0.x)/Dir.x : 1e9f;
+		float MaxY = Dir.y != 0 ? ((TileY+(StepY > 0 ? 1 : 0))*32.0f-Pos0.y)/Dir.y : 1e9f;
+
+		while(!(m_pFlags[TileOffset(TileX*32, TileY*32)]&COLFLAG_NEARSOLID))
+		{
+			if(MaxX < MaxY)
+			{
+				T = MaxX;
+				MaxX += DeltaX;
+				TileX += StepX;
+			}
+			else
+			{
+				T = MaxY;
+				MaxY += DeltaY;
+				TileY += StepY;
+			}
+
+			if(T > 1.0f)
+			{
+				i = End;
+				break;
+			}
+		}
+
+		// test the points one by one, starting a bit early to be safe
+		for(i = max(i, (int)(T*Distance)-1); i < End; i++)
+		{
+			vec2 Pos = mix(Pos0, Pos1, i/Distance);
+			if(CheckPoint(Pos.x, Pos.y))
+			{
+				if(pOutCollision)
+					*pOutCollision = Pos;
+				if(pOutBeforeCollision)
+					*pOutBeforeCollision = i ? mix(Pos0, Pos1, (i-1)/Distance) : Pos0;
+				return GetCollisionAt(Pos.x, Pos.y);
+			}
+
+			// back to walking the tiles once away from solid ones
+			if(!(m_pFlags[TileOffset((int)floorf(Pos.x/32.0f)*32, (int)floorf(Pos.y/32.0f)*32)]&COLFLAG_NEARSOLID))
+			{
+				i++;
+				break;
+			}
+		}
+	}
+
+	if(pOutCollision)
+		*pOutCollision = Pos1;
+	if(pOutBeforeCollision)
+		*pOutBeforeCollision = Pos1;
+	return 0;
 }
 
-// TODO: rewrite this smarter!
-int CCollision::IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
+// steps along the line one unit at a time, IntersectLine gives the same results
+int CCollision::IntersectLineReference(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
 {
 	float Distance = distance(Pos0, Pos1);
 	int End(Distance+1);
@@ -151,7 +348,136 @@ bool CCollision::TestBox(vec2 Pos, vec2 Size)
 	return false;
 }
 
+int CCollision::FreeSteps(vec2 Pos, vec2 Step, vec2 HalfSize)
+{
+	// don't skip far, the float error of the added steps has to stay
+	// well below the margin. far out positions aren't skipped at all
+	const int MaxSteps = 16;
+	if(!(max(absolute(Pos.x), absolute(Pos.y)) < 100000.0f))
+		return 0;
+
+	// number of steps until a corner of the box could round into another
+	// tile, the corners stay at least a unit away from the tile edges
+	int Steps = MaxSteps;
+	for(int a = 0; a < 2; a++)
+	{
+		float Move = a ? Step.y : Step.x;
+		for(int Side = -1; Side <= 1; Side += 2)
+		{
+			float Corner = a ? Pos.y+HalfSize.y*Side : Pos.x+HalfSize.x*Side;
+			float TileStart = floorf(Corner/32.0f)*32.0f;
+			float Low = TileStart+1.0f;
+			float High = TileStart+30.0f;
+			if(Corner < Low || Corner > High)
+				return 0;
+			if(Move > 0)
+				Steps = min(Steps, (int)((High-Corner)/Move));
+			else if(Move < 0)
+				Steps = min(Steps, (int)((Low-Corner)/Move));
+		}
+	}
+	return Steps;
+}
+
 void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity)
+{
+	if(m_RecordMoves)
+	{
+		CMoveTrace *pTrace = &m_aMoveTraces[m_MoveTraceIndex];
+		m_MoveTraceIndex = (m_MoveTraceIndex+1)%MAX_MOVE_TRACES;
+		if(m_MoveTraceIndex == 0)
+			m_MoveTracesFull = true;
+		pTrace->m_Pos = *pInoutPos;
+		pTrace->m_Vel = *pInoutVel;
+		pTrace->m_Size = Size;
+		pTrace->m_Elasticity = Elasticity;
+	}
+
+	// do the move
+	vec2 Pos = *pInoutPos;
+	vec2 Vel = *pInoutVel;
+
+	float Distance = length(Vel);
+	int Max = (int)Distance;
+
+	if(Distance > 0.00001f)
+	{
+		// the steps are the same as in MoveBoxReference, but after a step
+		// without collision the following ones that keep the corners of
+		// the box in the same tiles can't collide either and skip the tests
+		float Fraction = 1.0f/(float)(Max+1);
+		vec2 HalfSize = Size*0.5f;
+		for(int i = 0; i <= Max; i++)
+		{
+			vec2 NewPos = Pos + Vel*Fraction; // TODO: this row is not nice
+
+			if(TestBox(vec2(NewPos.x, NewPos.y), Size))
+			{
+				int Hits = 0;
+
+				if(TestBox(vec2(Pos.x, NewPos.y), Size))
+				{
+					NewPos.y = Pos.y;
+					Vel.y *= -Elasticity;
+					Hits++;
+				}
+
+				if(TestBox(vec2(NewPos.x, Pos.y), Size))
+				{
+					NewPos.x = Pos.x;
+					Vel.x *= -Elasticity;
+					Hits++;
+				}
+
+				// neither of the tests got a collision.
+				// this is a real _corner case_!
+				if(Hits == 0)
+				{
+					NewPos.y = Pos.y;
+					Vel.y *= -Elasticity;
+					NewPos.x = Pos.x;
+					Vel.x *= -Elasticity;
+				}
+
+				Pos = NewPos;
+				continue;
+			}
+
+			Pos = NewPos;
+
+			vec2 Step = Vel*Fraction;
+			for(int Free = min(FreeSteps(Pos, Step, HalfSize), Max-i); Free > 0; Free--, i++)
+				Pos = Pos + Vel*Fraction;
+		}
+	}
+
+	*pInoutPos = Pos;
+	*pInoutVel = Vel;
+}
+
+int CCollision::CompareMoves(int *pNumChecked)
+{
+	int Mismatches = 0;
+	int Num = m_MoveTracesFull ? (int)MAX_MOVE_TRACES : m_MoveTraceIndex;
+	for(int i = 0; i < Num; i++)
+	{
+		const CMoveTrace *pTrace = &m_aMoveTraces[i];
+		vec2 aPos[2] = {pTrace->m_Pos, pTrace->m_Pos};
+		vec2 aVel[2] = {pTrace->m_Vel, pTrace->m_Vel};
+		bool Record = m_RecordMoves;
+		m_RecordMoves = false;
+		MoveBox(&aPos[0], &aVel[0], pTrace->m_Size, pTrace->m_Elasticity);
+		m_RecordMoves = Record;
+		MoveBoxReference(&aPos[1], &aVel[1], pTrace->m_Size, pTrace->m_Elasticity);
+		if(mem_comp(&aPos[0], &aPos[1], sizeof(vec2)) != 0 || mem_comp(&aVel[0], &aVel[1], sizeof(vec2)) != 0)
+			Mismatches++;
+	}
+	*pNumChecked = Num;
+	return Mismatches;
+}
+
+// moves in length(Vel)+1 steps with a TestBox for each, MoveBox gives the same results
+void CCollision::MoveBoxReference(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity)
 {
 	// do the move
 	vec2 Pos = *pInoutPos;
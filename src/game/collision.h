@@ -3,6 +3,7 @@
 #ifndef GAME_COLLISION_H
 #define GAME_COLLISION_H
 
+#include <base/math.h>
 #include <base/vmath.h>
 
 class CCollision
@@ -12,6 +13,23 @@ class CCollision
 	int m_Height;
 	class CLayers *m_pLayers;
 
+	enum
+	{
+		// tiles around the map that repeat the border tiles
+		BORDER=4,
+	};
+
+	// per tile collision flags and tile indices, including the border.
+	// the pointers point at tile 0,0 inside the border
+	unsigned char *m_pFlagData;
+	unsigned char *m_pIndexData;
+	unsigned char *m_pTriggerData;
+	unsigned char *m_pFlags;
+	unsigned char *m_pIndices;
+	unsigned char *m_pTriggers;
+	int m_PaddedWidth;
+	int m_PaddedHeight;
+
 	struct telePos
 	{
 		int x;
@@ -21,9 +39,45 @@ class CCollision
 
 	telePos m_telePositions[4]; // positions of teleports
 
-	bool IsTileSolid(int x, int y);
-	int GetTile(int x, int y);
-	int GetTileNew(int x, int y);
+	// offset of the tile at x, y in the tile arrays
+	int TileOffset(int x, int y) const
+	{
+		// shifting rounds down, the border takes care of the
+		// difference to dividing, far away positions get clamped
+		int Nx = x>>5;
+		int Ny = y>>5;
+		if((unsigned)(Nx+BORDER) >= (unsigned)m_PaddedWidth || (unsigned)(Ny+BORDER) >= (unsigned)m_PaddedHeight)
+		{
+			Nx = clamp(Nx, 0, m_Width-1);
+			Ny = clamp(Ny, 0, m_Height-1);
+		}
+		return Ny*m_PaddedWidth+Nx;
+	}
+
+	static int TileFlags(int Index);
+	static int TileTriggers(int Index);
+	int FreeSteps(vec2 Pos, vec2 Step, vec2 HalfSize);
+
+	// the last MoveBox calls, for comparing against the reference
+	struct CMoveTrace
+	{
+		vec2 m_Pos;
+		vec2 m_Vel;
+		vec2 m_Size;
+		float m_Elasticity;
+	};
+	enum
+	{
+		MAX_MOVE_TRACES=1024,
+	};
+	CMoveTrace m_aMoveTraces[MAX_MOVE_TRACES];
+	int m_MoveTraceIndex;
+	bool m_MoveTracesFull;
+	bool m_RecordMoves;
+	bool IsTileSolid(int x, int y) { return m_pFlags[TileOffset(x, y)]&COLFLAG_SOLID; }
+	int GetTile(int x, int y) { return m_pFlags[TileOffset(x, y)]&(COLFLAG_SOLID|COLFLAG_DEATH|COLFLAG_NOHOOK); }
+	int GetTileNew(int x, int y) { return m_pIndices[TileOffset(x, y)]; }
+	int GetTileReference(int x, int y);
 
 public:
 	enum
@@ -36,19 +90,51 @@ public:
 		// COLFLAG_TELETHREE=32,
 		// COLFLAG_TELEFOUR=64,
 		COLFLAG_SLOWDEATH=128,
+
+		// only in the flag array, GetCollisionAt doesn't return these
+		COLFLAG_FREEZE=8,
+		COLFLAG_ZONE=16,
+		// the tile or one of its neighbours is solid
+		COLFLAG_NEARSOLID=32,
+	};
+
+	// tiles that do something to a character standing in them. the bits
+	// are handled in this order, so a melt is applied before a freeze
+	enum
+	{
+		TRIGGER_DEATH=1,
+		TRIGGER_UNFREEZE=2,
+		TRIGGER_FREEZE=4,
+		TRIGGER_SLOWDEATH=8,
+		TRIGGER_HEALTHZONE=16,
+		TRIGGER_ARMORZONE=32,
+		TRIGGER_SPEEDUP=64,
+		TRIGGER_NOFLAG=128,
+		NUM_TRIGGERS=8,
 	};
 
 	CCollision();
+	~CCollision();
 	void Init(class CLayers *pLayers);
+	// takes the arrays pOther built for the same map, pLayers replaces its layers
+	void TakeOver(CCollision *pOther, class CLayers *pLayers);
 	bool CheckPoint(float x, float y) { return IsTileSolid(roundbyteeworlds(x), roundbyteeworlds(y)); }
 	bool CheckPoint(vec2 Pos) { return CheckPoint(Pos.x, Pos.y); }
 	int GetCollisionAt(float x, float y) { return GetTile(roundbyteeworlds(x), roundbyteeworlds(y)); }
 	int GetCollisionAtNew(float x, float y) { return GetTileNew(roundbyteeworlds(x), roundbyteeworlds(y)); }
+	int GetCollisionAtReference(float x, float y) { return GetTileReference(roundbyteeworlds(x), roundbyteeworlds(y)); }
+	int GetFlagsAt(float x, float y) { return m_pFlags[TileOffset(roundbyteeworlds(x), roundbyteeworlds(y))]; }
+	int GetTriggersAt(float x, float y) { return m_pTriggers[TileOffset(roundbyteeworlds(x), roundbyteeworlds(y))]; }
+	int GetTriggers(vec2 Pos, float Offset);
 	int GetWidth() { return m_Width; };
 	int GetHeight() { return m_Height; };
 	int IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision);
+	int IntersectLineReference(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision);
 	void MovePoint(vec2 *pInoutPos, vec2 *pInoutVel, float Elasticity, int *pBounces);
 	void MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity);
+	void MoveBoxReference(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity);
+	void RecordMoves(bool Record) { m_RecordMoves = Record; }
+	int CompareMoves(int *pNumChecked);
 	bool TestBox(vec2 Pos, vec2 Size);
 	int getTeleX(int index);
 	int getTeleY(int index);
@@ -56,10 +56,145 @@ float VelocityRamp(float Value, float Start, float Range, float Curvature)
 	return 1.0f/powf(Curvature, (Value-Start)/Range);
 }
 
+int CWorldCore::BroadphaseCoord(float v)
+{
+	// far away and broken positions end up in the outermost cells
+	if(!(v > -1000000.0f))
+		v = -1000000.0f;
+	if(!(v < 1000000.0f))
+		v = 1000000.0f;
+	return (int)floorf(v/BROADPHASE_CELL_SIZE);
+}
+
+void CWorldCore::BroadphaseInsert(int ClientID)
+{
+	vec2 Pos = m_apBroadphaseCores[ClientID]->m_Pos;
+	int Bucket = BroadphaseHash(BroadphaseCoord(Pos.x), BroadphaseCoord(Pos.y));
+	m_aBroadphasePos[ClientID] = Pos;
+	m_aBroadphaseBucket[ClientID] = Bucket;
+	m_aBroadphaseNext[ClientID] = m_aBroadphaseBuckets[Bucket];
+	m_aBroadphaseBuckets[Bucket] = ClientID;
+}
+
+void CWorldCore::BroadphaseRemove(int ClientID)
+{
+	int *pLink = &m_aBroadphaseBuckets[m_aBroadphaseBucket[ClientID]];
+	while(*pLink != ClientID)
+		pLink = &m_aBroadphaseNext[*pLink];
+	*pLink = m_aBroadphaseNext[ClientID];
+}
+
+void CWorldCore::BuildBroadphase()
+{
+	for(int i = 0; i < BROADPHASE_BUCKETS; i++)
+		m_aBroadphaseBuckets[i] = -1;
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		m_apBroadphaseCores[i] = m_apCharacters[i];
+		if(!m_apCharacters[i])
+			continue;
+		m_apCharacters[i]->m_BroadphaseID = i;
+		BroadphaseInsert(i);
+	}
+	m_BroadphaseValid = true;
+}
+
+void CWorldCore::UpdateBroadphase(CCharacterCore *pCore)
+{
+	int ClientID = pCore->m_BroadphaseID;
+	if(!m_BroadphaseValid || ClientID < 0 || ClientID >= MAX_CLIENTS || m_apBroadphaseCores[ClientID] != pCore)
+		return;
+	if(m_aBroadphasePos[ClientID] == pCore->m_Pos)
+		return;
+
+	BroadphaseRemove(ClientID);
+	BroadphaseInsert(ClientID);
+}
+
+int CWorldCore::QueryBroadphase(vec2 Min, vec2 Max, int *pIDs)
+{
+	int Num = 0;
+	if(!m_BroadphaseValid)
+	{
+		for(int i = 0; i < MAX_CLIENTS; i++)
+			if(m_apCharacters[i])
+				pIDs[Num++] = i;
+		return Num;
+	}
+
+	int x0 = BroadphaseCoord(Min.x);
+	int y0 = BroadphaseCoord(Min.y);
+	int x1 = BroadphaseCoord(Max.x);
+	int y1 = BroadphaseCoord(Max.y);
+
+	if(x1-x0 >= BROADPHASE_BUCKETS || y1-y0 >= BROADPHASE_BUCKETS || (x1-x0+1)*(y1-y0+1) > BROADPHASE_BUCKETS)
+	{
+		// the box covers more cells than there are buckets
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			vec2 Pos = m_aBroadphasePos[i];
+			if(m_apCharacters[i] && m_apCharacters[i] == m_apBroadphaseCores[i] &&
+				Pos.x >= Min.x && Pos.x <= Max.x && Pos.y >= Min.y && Pos.y <= Max.y)
+				pIDs[Num++] = i;
+		}
+	}
+	else
+	{
+		// cells can share a bucket, every bucket is only walked once
+		m_BroadphaseQuery++;
+		for(int y = y0; y <= y1; y++)
+			for(int x = x0; x <= x1; x++)
+			{
+				int Bucket = BroadphaseHash(x, y);
+				if(m_aBroadphaseBucketQuery[Bucket] == m_BroadphaseQuery)
+					continue;
+				m_aBroadphaseBucketQuery[Bucket] = m_BroadphaseQuery;
+
+				for(int i = m_aBroadphaseBuckets[Bucket]; i != -1; i = m_aBroadphaseNext[i])
+				{
+					// characters removed since the build are skipped
+					vec2 Pos = m_aBroadphasePos[i];
+					if(m_apCharacters[i] == m_apBroadphaseCores[i] &&
+						Pos.x >= Min.x && Pos.x <= Max.x && Pos.y >= Min.y && Pos.y <= Max.y)
+						pIDs[Num++] = i;
+				}
+			}
+
+		// back into client id order
+		for(int i = 1; i < Num; i++)
+		{
+			int ID = pIDs[i];
+			int j = i;
+			for(; j > 0 && pIDs[j-1] > ID; j--)
+				pIDs[j] = pIDs[j-1];
+			pIDs[j] = ID;
+		}
+	}
+
+	if(g_Config.m_DbgCoreBroadphase)
+	{
+		for(int i = 0, c = 0; i < MAX_CLIENTS; i++)
+		{
+			if(!m_apCharacters[i])
+				continue;
+			vec2 Pos = m_apCharacters[i]->m_Pos;
+			bool Inside = Pos.x >= Min.x && Pos.x <= Max.x && Pos.y >= Min.y && Pos.y <= Max.y;
+			while(c < Num && pIDs[c] < i)
+				c++;
+			if(Inside != (c < Num && pIDs[c] == i))
+				dbg_msg("gamecore", "broadphase mismatch for client %d", i);
+		}
+	}
+
+	return Num;
+}
+
 void CCharacterCore::Init(CWorldCore *pWorld, CCollision *pCollision)
 {
 	m_pWorld = pWorld;
 	m_pCollision = pCollision;
+	m_BroadphaseID = -1;
 }
 
 void CCharacterCore::Reset()
@@ -212,9 +347,16 @@ void CCharacterCore::Tick(bool UseInput)
 		// Check against other players first
 		if(m_pWorld && m_pWorld->m_Tuning.m_PlayerHooking)
 		{
+			// only characters near the hook line can be hit
+			float Range = PhysSize+3.0f;
+			int aIDs[MAX_CLIENTS];
+			int Num = m_pWorld->QueryBroadphase(vec2(min(m_HookPos.x, NewPos.x)-Range, min(m_HookPos.y, NewPos.y)-Range),
+				vec2(max(m_HookPos.x, NewPos.x)+Range, max(m_HookPos.y, NewPos.y)+Range), aIDs);
+
 			float Distance = 0.0f;
-			for(int i = 0; i < MAX_CLIENTS; i++)
+			for(int c = 0; c < Num; c++)
 			{
+				int i = aIDs[c];
 				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[i];
 				if(!pCharCore || pCharCore == this)
 					continue;
@@ -316,8 +458,27 @@ void CCharacterCore::Tick(bool UseInput)
 
 	if(m_pWorld)
 	{
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		// the characters close enough to collide and the hooked one
+		float Range = PhysSize*1.25f+1.0f;
+		int aIDs[MAX_CLIENTS];
+		int Num = m_pWorld->QueryBroadphase(m_Pos-vec2(Range, Range), m_Pos+vec2(Range, Range), aIDs);
+		if(m_HookedPlayer >= 0 && m_HookedPlayer < MAX_CLIENTS)
+		{
+			int c = 0;
+			while(c < Num && aIDs[c] < m_HookedPlayer)
+				c++;
+			if(c == Num || aIDs[c] != m_HookedPlayer)
+			{
+				for(int j = Num; j > c; j--)
+					aIDs[j] = aIDs[j-1];
+				aIDs[c] = m_HookedPlayer;
+				Num++;
+			}
+		}
+
+		for(int c = 0; c < Num; c++)
 		{
+			int i = aIDs[c];
 			CCharacterCore *pCharCore = m_pWorld->m_apCharacters[i];
 			if(!pCharCore)
 				continue;
@@ -392,17 +553,22 @@ void CCharacterCore::Move()
 
 	if(m_pWorld && m_pWorld->m_Tuning.m_PlayerCollision)
 	{
-		// check player collision
+		// check player collision, against the characters near the path
+		float Range = 29.0f;
+		int aIDs[MAX_CLIENTS];
+		int Num = m_pWorld->QueryBroadphase(vec2(min(m_Pos.x, NewPos.x)-Range, min(m_Pos.y, NewPos.y)-Range),
+			vec2(max(m_Pos.x, NewPos.x)+Range, max(m_Pos.y, NewPos.y)+Range), aIDs);
+
 		float Distance = distance(m_Pos, NewPos);
 		int End = Distance+1;
 		vec2 LastPos = m_Pos;
-		for(int i = 0; i < End; i++)
+		for(int i = 0; i < End && Num; i++)
 		{
 			float a = i/Distance;
 			vec2 Pos = mix(m_Pos, NewPos, a);
-			for(int p = 0; p < MAX_CLIENTS; p++)
+			for(int c = 0; c < Num; c++)
 			{
-				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[p];
+				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[aIDs[c]];
 				if(!pCharCore || pCharCore == this)
 					continue;
 				float D = distance(Pos, pCharCore->m_Pos);
@@ -412,6 +578,7 @@ void CCharacterCore::Move()
 						m_Pos = LastPos;
 					else if(distance(NewPos, pCharCore->m_Pos) > D)
 						m_Pos = NewPos;
+					m_pWorld->UpdateBroadphase(this);
 					return;
 				}
 			}
@@ -420,6 +587,8 @@ void CCharacterCore::Move()
 	}
 
 	m_Pos = NewPos;
+	if(m_pWorld)
+		m_pWorld->UpdateBroadphase(this);
 }
 
 void CCharacterCore::Write(CNetObj_CharacterCore *pObjCore)
@@ -464,4 +633,6 @@ void CCharacterCore::Quantize()
 	CNetObj_CharacterCore Core;
 	Write(&Core);
 	Read(&Core);
+	if(m_pWorld)
+		m_pWorld->UpdateBroadphase(this);
 }
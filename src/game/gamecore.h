@@ -162,14 +162,51 @@ enum
 
 class CWorldCore
 {
+	enum
+	{
+		BROADPHASE_CELL_SIZE=64,
+		BROADPHASE_BUCKETS=256,
+	};
+
+	// the characters hashed into buckets by the cell of their position,
+	// as linked lists of client ids
+	int m_aBroadphaseBuckets[BROADPHASE_BUCKETS];
+	int m_aBroadphaseNext[MAX_CLIENTS];
+	int m_aBroadphaseBucket[MAX_CLIENTS];
+	vec2 m_aBroadphasePos[MAX_CLIENTS];
+	class CCharacterCore *m_apBroadphaseCores[MAX_CLIENTS];
+	unsigned m_aBroadphaseBucketQuery[BROADPHASE_BUCKETS];
+	unsigned m_BroadphaseQuery;
+	bool m_BroadphaseValid;
+
+	static int BroadphaseCoord(float v);
+	static int BroadphaseHash(int x, int y) { return ((unsigned)x*73856093u ^ (unsigned)y*19349663u)&(BROADPHASE_BUCKETS-1); }
+	void BroadphaseInsert(int ClientID);
+	void BroadphaseRemove(int ClientID);
+
 public:
 	CWorldCore()
 	{
 		mem_zero(m_apCharacters, sizeof(m_apCharacters));
+		mem_zero(m_aBroadphaseBucketQuery, sizeof(m_aBroadphaseBucketQuery));
+		m_BroadphaseQuery = 0;
+		m_BroadphaseValid = false;
 	}
 
 	CTuningParams m_Tuning;
 	class CCharacterCore *m_apCharacters[MAX_CLIENTS];
+
+	/*
+		The broadphase holds the positions of the characters when it was
+		built, the cores update their entry when they move. Queries return
+		the client ids of the characters in a box in ascending order, the
+		same order a loop over m_apCharacters visits them in. Without a
+		built broadphase every character is returned.
+	*/
+	void BuildBroadphase();
+	void InvalidateBroadphase() { m_BroadphaseValid = false; }
+	void UpdateBroadphase(class CCharacterCore *pCore);
+	int QueryBroadphase(vec2 Min, vec2 Max, int *pIDs);
 };
 
 class CCharacterCore
@@ -207,6 +244,8 @@ public:
 	void Quantize();
 
 	bool m_WillExplode; // whether or not to explode next tick
+
+	int m_BroadphaseID; // set by CWorldCore::BuildBroadphase
 };
 
 #endif
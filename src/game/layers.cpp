@@ -15,7 +15,12 @@ CLayers::CLayers()
 
 void CLayers::Init(class IKernel *pKernel)
 {
-	m_pMap = pKernel->RequestInterface<IMap>();
+	Init(pKernel->RequestInterface<IMap>());
+}
+
+void CLayers::Init(class IMap *pMap)
+{
+	m_pMap = pMap;
 	m_pMap->GetType(MAPITEMTYPE_GROUP, &m_GroupsStart, &m_GroupsNum);
 	m_pMap->GetType(MAPITEMTYPE_LAYER, &m_LayersStart, &m_LayersNum);
 
@@ -0,0 +1,135 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_CLIENTMASK_H
+#define GAME_SERVER_CLIENTMASK_H
+
+#include <engine/shared/protocol.h>
+
+/*
+	Class: CClientMask
+		One bit per client slot, for all MAX_CLIENTS slots. Used to
+		select the clients an event or sound is sent to.
+*/
+class CClientMask
+{
+	enum
+	{
+		NUM_WORDS=(MAX_CLIENTS+31)/32,
+	};
+
+	unsigned m_aWords[NUM_WORDS];
+
+	static int CountBits(unsigned Word)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcount(Word);
+#else
+		int Count = 0;
+		for(; Word; Word &= Word-1)
+			Count++;
+		return Count;
+#endif
+	}
+
+	static int LowestBit(unsigned Word)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctz(Word);
+#else
+		int Bit = 0;
+		while(!(Word&1))
+		{
+			Word >>= 1;
+			Bit++;
+		}
+		return Bit;
+#endif
+	}
+
+public:
+	CClientMask() { Clear(); }
+
+	void Clear()
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] = 0;
+	}
+
+	void SetAll()
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] = ~0u;
+		if(MAX_CLIENTS%32)
+			m_aWords[NUM_WORDS-1] = (1u<<(MAX_CLIENTS%32))-1;
+	}
+
+	void Set(int ClientID) { m_aWords[ClientID/32] |= 1u<<(ClientID%32); }
+	void Unset(int ClientID) { m_aWords[ClientID/32] &= ~(1u<<(ClientID%32)); }
+	bool IsSet(int ClientID) const { return (m_aWords[ClientID/32]>>(ClientID%32))&1; }
+
+	bool IsEmpty() const
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			if(m_aWords[i])
+				return false;
+		return true;
+	}
+
+	int Count() const
+	{
+		int Count = 0;
+		for(int i = 0; i < NUM_WORDS; i++)
+			Count += CountBits(m_aWords[i]);
+		return Count;
+	}
+
+	// the lowest client id at or after Start, -1 if there is none.
+	// for(int i = Mask.Next(0); i != -1; i = Mask.Next(i+1)) walks all
+	int Next(int Start) const
+	{
+		if(Start >= MAX_CLIENTS)
+			return -1;
+		int w = Start/32;
+		unsigned Word = m_aWords[w] & (~0u<<(Start%32));
+		while(!Word)
+		{
+			if(++w == NUM_WORDS)
+				return -1;
+			Word = m_aWords[w];
+		}
+		return w*32 + LowestBit(Word);
+	}
+
+	CClientMask &operator|=(const CClientMask &Other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] |= Other.m_aWords[i];
+		return *this;
+	}
+
+	CClientMask &operator&=(const CClientMask &Other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] &= Other.m_aWords[i];
+		return *this;
+	}
+
+	CClientMask operator|(const CClientMask &Other) const { CClientMask Mask = *this; return Mask |= Other; }
+	CClientMask operator&(const CClientMask &Other) const { CClientMask Mask = *this; return Mask &= Other; }
+
+	bool operator==(const CClientMask &Other) const
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			if(m_aWords[i] != Other.m_aWords[i])
+				return false;
+		return true;
+	}
+	bool operator!=(const CClientMask &Other) const { return !(*this == Other); }
+};
+
+inline CClientMask CmaskAll() { CClientMask Mask; Mask.SetAll(); return Mask; }
+inline CClientMask CmaskOne(int ClientID) { CClientMask Mask; Mask.Set(ClientID); return Mask; }
+inline CClientMask CmaskAllExceptOne(int ClientID) { CClientMask Mask = CmaskAll(); Mask.Unset(ClientID); return Mask; }
+inline bool CmaskIsSet(const CClientMask &Mask, int ClientID) { return Mask.IsSet(ClientID); }
+
+#endif
@@ -43,9 +43,11 @@ bool CGameContext::ShowCommand(int ClientID, CPlayer* pPlayer, const char* pMess
 	}
 	else if(StrLeftComp(pMessage, "w")) {
 	    	pPlayer->m_Anonymous = true;
+	    	pPlayer->InvalidateClientInfo();
 	}
 	else if(StrLeftComp(pMessage, "s")) {
 	    	pPlayer->m_Anonymous = false;
+	    	pPlayer->InvalidateClientInfo();
 	}
 	else if(m_pController->m_pPausable && (StrLeftComp(pMessage, "pause") || StrLeftComp(pMessage, "spec"))) {
 		pPlayer->SetTeam(abs(pPlayer->GetTeam())-1,false,false);
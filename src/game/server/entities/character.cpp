@@ -160,6 +160,7 @@ void CCharacter::HandleNinja()
 		m_Core.m_Vel = m_Ninja.m_ActivationDir * g_pData->m_Weapons.m_Ninja.m_Velocity;
 		vec2 OldPos = m_Pos;
 		GameServer()->Collision()->MoveBox(&m_Core.m_Pos, &m_Core.m_Vel, vec2(m_ProximityRadius, m_ProximityRadius), 0.f);
+		GameServer()->m_World.m_Core.UpdateBroadphase(&m_Core);
 
 		// reset velocity so the client doesn't predict stuff
 		m_Core.m_Vel = vec2(0.f, 0.f);
@@ -704,62 +705,12 @@ void CCharacter::Tick() {
 	m_Core.m_Input = m_Input;
 	m_Core.Tick(true);
 
-	// handle death-tiles and leaving gamelayer
-	if (GameServer()->Collision()->GetCollisionAt(m_Pos.x + m_ProximityRadius / 3.f, m_Pos.y - m_ProximityRadius / 3.f) & CCollision::COLFLAG_DEATH ||
-		GameServer()->Collision()->GetCollisionAt(m_Pos.x + m_ProximityRadius / 3.f, m_Pos.y + m_ProximityRadius / 3.f) & CCollision::COLFLAG_DEATH ||
-		GameServer()->Collision()->GetCollisionAt(m_Pos.x - m_ProximityRadius / 3.f, m_Pos.y - m_ProximityRadius / 3.f) & CCollision::COLFLAG_DEATH ||
-		GameServer()->Collision()->GetCollisionAt(m_Pos.x - m_ProximityRadius / 3.f, m_Pos.y + m_ProximityRadius / 3.f) & CCollision::COLFLAG_DEATH ||
-		GameLayerClipped(m_Pos))
-	{
-		if (!g_Config.m_SvHookkill || GameServer()->m_pController->IsIFreeze()) {
-			Die(m_pPlayer->GetCID(), WEAPON_WORLD);
-		} else {
-			int From = m_pPlayer->GetCID();
-			CCharacterCore pCharCore = *GetCore();
-			if (pCharCore.m_LastHooked > 0) {
-				From = pCharCore.m_LastHookedBy;
-				pCharCore.m_LastHooked = 0;
-				// set attacker's face to happy (taunt!)
-				if (From >= 0 && From != m_pPlayer->GetCID() && GameServer()->m_apPlayers[From])
-				{
-					CCharacter *pChr = GameServer()->m_apPlayers[From]->GetCharacter();
-					if (pChr)
-					{
-						pChr->m_EmoteType = EMOTE_HAPPY;
-						pChr->m_EmoteStop = Server()->Tick() + Server()->TickSpeed();
-					}
-				}
-				// do damage Hit sound
-				if (From >= 0 && From != m_pPlayer->GetCID() && GameServer()->m_apPlayers[From])
-				{
-					int Mask = CmaskOne(From);
-					for (int i = 0; i < MAX_CLIENTS; i++)
-					{
-						if (GameServer()->m_apPlayers[i] && GameServer()->m_apPlayers[i]->GetTeam() == TEAM_SPECTATORS && GameServer()->m_apPlayers[i]->m_SpectatorID == From)
-							Mask |= CmaskOne(i);
-					}
-					GameServer()->CreateSound(GameServer()->m_apPlayers[From]->m_ViewPos, SOUND_HIT, Mask);
-				}
-			}
-			Die(From, WEAPON_NINJA);
-		}
-	}
- if ((GameServer()->Collision()->GetCollisionAtNew(m_Pos.x + m_ProximityRadius / 100.f, m_Pos.y - m_ProximityRadius / 100.f) == TILE_FREEZE+2 ||
-        GameServer()->Collision()->GetCollisionAtNew(m_Pos.x + m_ProximityRadius / 100.f, m_Pos.y + m_ProximityRadius / 100.f) == TILE_FREEZE+2 ||
-        GameServer()->Collision()->GetCollisionAtNew(m_Pos.x - m_ProximityRadius / 100.f, m_Pos.y - m_ProximityRadius / 100.f) == TILE_FREEZE+2 ||
-        GameServer()->Collision()->GetCollisionAtNew(m_Pos.x - m_ProximityRadius / 100.f, m_Pos.y + m_ProximityRadius / 100.f) == TILE_FREEZE+2))
-    {
-        Melt();
-    };
-    if ((GameServer()->Collision()->GetCollisionAtNew(m_Pos.x + m_ProximityRadius / 100.f, m_Pos.y - m_ProximityRadius / 100.f) == TILE_FREEZE ||
-        GameServer()->Collision()->GetCollisionAtNew(m_Pos.x + m_ProximityRadius / 100.f, m_Pos.y + m_ProximityRadius / 100.f) == TILE_FREEZE ||
-        GameServer()->Collision()->GetCollisionAtNew(m_Pos.x - m_ProximityRadius / 100.f, m_Pos.y - m_ProximityRadius / 100.f) == TILE_FREEZE ||
-        GameServer()->Collision()->GetCollisionAtNew(m_Pos.x - m_ProximityRadius / 100.f, m_Pos.y + m_ProximityRadius / 100.f) == TILE_FREEZE))
-    {
-        Freeze(3);//m_FreezeTicks = 120;
-    };
-
-
+	// handle the tiles the character touches and leaving gamelayer
+	int Triggers = GameServer()->Collision()->GetTriggers(m_Pos, m_ProximityRadius / 3.f) & CCollision::TRIGGER_DEATH;
+	Triggers |= GameServer()->Collision()->GetTriggers(m_Pos, m_ProximityRadius / 100.f) & ~CCollision::TRIGGER_DEATH;
+	if (GameLayerClipped(m_Pos))
+		Triggers |= CCollision::TRIGGER_DEATH;
+	GameServer()->m_pController->HandleTriggers(this, Triggers);
 
 	if (m_Core.m_WillExplode && m_ActiveWeapon != WEAPON_NINJA) {
 		Die(m_pPlayer->GetCID(), WEAPON_NINJA);
@@ -775,6 +726,42 @@ void CCharacter::Tick() {
 	return;
 }
 
+void CCharacter::DieOnTile()
+{
+	if (!g_Config.m_SvHookkill || GameServer()->m_pController->IsIFreeze()) {
+		Die(m_pPlayer->GetCID(), WEAPON_WORLD);
+	} else {
+		int From = m_pPlayer->GetCID();
+		CCharacterCore pCharCore = *GetCore();
+		if (pCharCore.m_LastHooked > 0) {
+			From = pCharCore.m_LastHookedBy;
+			pCharCore.m_LastHooked = 0;
+			// set attacker's face to happy (taunt!)
+			if (From >= 0 && From != m_pPlayer->GetCID() && GameServer()->m_apPlayers[From])
+			{
+				CCharacter *pChr = GameServer()->m_apPlayers[From]->GetCharacter();
+				if (pChr)
+				{
+					pChr->m_EmoteType = EMOTE_HAPPY;
+					pChr->m_EmoteStop = Server()->Tick() + Server()->TickSpeed();
+				}
+			}
+			// do damage Hit sound
+			if (From >= 0 && From != m_pPlayer->GetCID() && GameServer()->m_apPlayers[From])
+			{
+				CClientMask Mask = CmaskOne(From);
+				for (int i = 0; i < MAX_CLIENTS; i++)
+				{
+					if (GameServer()->m_apPlayers[i] && GameServer()->m_apPlayers[i]->GetTeam() == TEAM_SPECTATORS && GameServer()->m_apPlayers[i]->m_SpectatorID == From)
+						Mask.Set(i);
+				}
+				GameServer()->CreateSound(GameServer()->m_apPlayers[From]->m_ViewPos, SOUND_HIT, Mask);
+			}
+		}
+		Die(From, WEAPON_NINJA);
+	}
+}
+
 void CCharacter::TickDefered()
 {
 	// advance the dummy
@@ -796,6 +783,7 @@ void CCharacter::TickDefered()
 	m_Core.Quantize();
 	bool StuckAfterQuant = GameServer()->Collision()->TestBox(m_Core.m_Pos, vec2(28.0f, 28.0f));
 	m_Pos = m_Core.m_Pos;
+	GameServer()->m_World.UpdateEntityPos(this);
 
 	if (!StuckBefore && (StuckAfterMove || StuckAfterQuant))
 	{
@@ -824,7 +812,7 @@ void CCharacter::TickDefered()
 	}
 
 	int Events = m_Core.m_TriggeredEvents;
-	int Mask = CmaskAllExceptOne(m_pPlayer->GetCID());
+	CClientMask Mask = CmaskAllExceptOne(m_pPlayer->GetCID());
 
 	if (Events & COREEVENT_HOOK_ATTACH_PLAYER)
 		GameServer()->CreateSound(m_Pos, SOUND_HOOK_ATTACH_PLAYER, CmaskAll());
@@ -898,12 +886,7 @@ void CCharacter::Die(int Killer, int Weapon)    {
 		GameServer()->m_apPlayers[Killer]->m_Stats.m_Kills++;
 
 	// send the kill message
-	CNetMsg_Sv_KillMsg Msg;
-	Msg.m_Killer = Killer;
-	Msg.m_Victim = m_pPlayer->GetCID();
-	Msg.m_Weapon = Weapon;
-	Msg.m_ModeSpecial = ModeSpecial;
-	Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
+	GameServer()->SendKillMsg(Killer, m_pPlayer->GetCID(), Weapon, ModeSpecial);
 	GameServer()->CreateSound(m_Pos, SOUND_PLAYER_DIE);
 
 	m_pPlayer->m_DieTick = 0;
@@ -953,10 +936,10 @@ bool CCharacter::TakeDamage(vec2 Force, int Dmg, int From, int Weapon)  {
 	m_DamageTakenTick = Server()->Tick();
 	// do damage Hit sound
 	if (From >= 0 && From != m_pPlayer->GetCID() && GameServer()->m_apPlayers[From])	{
-		int Mask = CmaskOne(From);
+		CClientMask Mask = CmaskOne(From);
 		for (int i = 0; i < MAX_CLIENTS; i++)   {
 			if (GameServer()->m_apPlayers[i] && GameServer()->m_apPlayers[i]->GetTeam() == TEAM_SPECTATORS && GameServer()->m_apPlayers[i]->m_SpectatorID == From)
-				Mask |= CmaskOne(i);
+				Mask.Set(i);
 		}   GameServer()->CreateSound(GameServer()->m_apPlayers[From]->m_ViewPos, SOUND_HIT, Mask); }
 
 	// check for death
@@ -48,6 +48,7 @@ public:
 	void FireWeapon();
 
 	void Die(int Killer, int Weapon);
+	void DieOnTile();
 	bool TakeDamage(vec2 Force, int Dmg, int From, int Weapon);
 
 	bool Spawn(class CPlayer *pPlayer, vec2 Pos);
@@ -3,6 +3,8 @@
 #include <game/server/gamecontext.h>
 #include "flag.h"
 
+MACRO_ALLOC_POOL_ENTITY_IMPL(CFlag, CGameWorld::ENTTYPE_FLAG)
+
 CFlag::CFlag(CGameWorld *pGameWorld, int Team)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_FLAG)
 {
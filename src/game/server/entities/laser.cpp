@@ -10,6 +10,8 @@
 // # define M_PI		3.14159265358979323846	/* pi */
 // #endif
 
+MACRO_ALLOC_POOL_ENTITY_IMPL(CLaser, CGameWorld::ENTTYPE_LASER)
+
 CLaser::CLaser(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner, int clockwise, int Type)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_LASER)
 {
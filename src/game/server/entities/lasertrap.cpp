@@ -11,6 +11,8 @@
 # define M_PI		3.14159265358979323846	/* pi */
 #endif
 
+MACRO_ALLOC_POOL_ENTITY_IMPL(CLaserTrap, CGameWorld::ENTTYPE_LASER)
+
 CLaserTrap::CLaserTrap(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_LASER)
 {
@@ -7,6 +7,8 @@
 
 class CLaserTrap : public CEntity
 {
+	MACRO_ALLOC_POOL_ENTITY()
+
 public:
 	CLaserTrap(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner);
 
@@ -3,9 +3,11 @@
 #include <game/server/gamecontext.h>
 #include "loltext.h"
 
-ClolPlasma *CLoltext::s_aapPlasma[MAX_LOLTEXTS][MAX_PLASMA_PER_LOLTEXT];
+CEntityHandle CLoltext::s_aaPlasma[MAX_LOLTEXTS][MAX_PLASMA_PER_LOLTEXT];
 int CLoltext::s_aExpire[MAX_LOLTEXTS];
 
+MACRO_ALLOC_POOL_ENTITY_IMPL(ClolPlasma, CGameWorld::ENTTYPE_LASER)
+
 ClolPlasma::ClolPlasma(CGameWorld *pGameWorld, CEntity *pParent, vec2 Pos, vec2 Vel, int Lifespan)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_LASER)
 {
@@ -15,7 +17,8 @@ ClolPlasma::ClolPlasma(CGameWorld *pGameWorld, CEntity *pParent, vec2 Pos, vec2
 	m_Vel = Vel;
 	m_Life = Lifespan;
 	m_StartTick = Server()->Tick();
-	m_pParent = pParent;
+	if(pParent)
+		m_Parent = pParent->Handle();
 	GameWorld()->InsertEntity(this);
 }
 
@@ -92,7 +95,7 @@ int CLoltext::Create(CGameWorld *pGameWorld, CEntity *pParent, vec2 Pos, vec2 Ve
 	int NumPlasmas = 0;
 
 	for(int i = 0; i < MAX_PLASMA_PER_LOLTEXT; i++)
-		s_aapPlasma[TextID][i] = 0;
+		s_aaPlasma[TextID][i] = CEntityHandle();
 
 	while((c = *pText++))
 	{
@@ -104,8 +107,8 @@ int CLoltext::Create(CGameWorld *pGameWorld, CEntity *pParent, vec2 Pos, vec2 Ve
 		for(int y = 0; y < 5/*XXX*/; ++y)
 			for(int x = 0; x < 3/*XXX*/; ++x)
 				if (s_aaaChars[(unsigned)c][y][x] && NumPlasmas < MAX_PLASMA_PER_LOLTEXT)
-					s_aapPlasma[TextID][NumPlasmas++] =
-						        new ClolPlasma(pGameWorld, pParent, CurPos + vec2(x*56.0f, y*56.0f), Vel, Lifespan);
+					s_aaPlasma[TextID][NumPlasmas++] =
+						        (new ClolPlasma(pGameWorld, pParent, CurPos + vec2(x*56.0f, y*56.0f), Vel, Lifespan))->Handle();
 		CurPos.x += 56.0f;
 	}
 	return TextID;
@@ -120,9 +123,9 @@ void CLoltext::Dump()
 	{
 		int Count = 0;
 		for(int j = 0; j < MAX_PLASMA_PER_LOLTEXT; j++)
-			if (s_aapPlasma[i][j])
+			if (!s_aaPlasma[i][j].IsNull())
 				Count++;
-		dbg_msg("tl", "|s_aapPlasma[%d]| = %d", i, Count);
+		dbg_msg("tl", "|s_aaPlasma[%d]| = %d", i, Count);
 	}
 
 }
@@ -146,8 +149,11 @@ void CLoltext::Destroy(CGameWorld *pGameWorld, int TextID)
 	}
 
 	for(int i = 0; i < MAX_PLASMA_PER_LOLTEXT; i++)
-		if (s_aapPlasma[TextID][i])
-			s_aapPlasma[TextID][i]->Reset();
+	{
+		CEntity *pPlasma = pGameWorld->GetEntity(s_aaPlasma[TextID][i], CGameWorld::ENTTYPE_LASER);
+		if (pPlasma)
+			pPlasma->Reset();
+	}
 
 	s_aExpire[TextID] = 0;
 }
@@ -11,6 +11,8 @@
 
 class ClolPlasma : public CEntity
 {
+	MACRO_ALLOC_POOL_ENTITY()
+
 public:
 	//position relative to pParent->m_Pos. if pParent is NULL, Pos is absolute. lifespan in ticks
 	ClolPlasma(CGameWorld *pGameWorld, CEntity *pParent, vec2 Pos, vec2 Vel, int Lifespan);
@@ -26,14 +28,14 @@ private:
 	int m_Life; // remaining ticks
 	int m_StartTick; // tick created
 	vec2 m_StartOff; // initial offset from parent, for proper following
-	CEntity *m_pParent;
+	CEntityHandle m_Parent;
 };
 
 class CLoltext
 {
 private:
 	static bool s_aaaChars[256][5][3];
-	static ClolPlasma *s_aapPlasma[MAX_LOLTEXTS][MAX_PLASMA_PER_LOLTEXT];
+	static CEntityHandle s_aaPlasma[MAX_LOLTEXTS][MAX_PLASMA_PER_LOLTEXT]; // the plasmas can be gone already
 	static int s_aExpire[MAX_LOLTEXTS];
 	static bool HasRepr(char c);
 public:
@@ -5,6 +5,8 @@
 #include "pickup.h"
 #include "projectile.h"
 
+MACRO_ALLOC_POOL_ENTITY_IMPL(CPickup, CGameWorld::ENTTYPE_PICKUP)
+
 CPickup::CPickup(CGameWorld *pGameWorld, int Type, int SubType, bool remove_on_pickup)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PICKUP)
 {
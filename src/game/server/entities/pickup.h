@@ -9,6 +9,8 @@ const int PickupPhysSize = 14;
 
 class CPickup : public CEntity
 {
+	MACRO_ALLOC_POOL_ENTITY()
+
 public:
 	CPickup(CGameWorld *pGameWorld, int Type, int SubType = 0, bool remove_on_pickup = false);
 
@@ -12,6 +12,8 @@
 #include "laser.h"
 #include "projectile.h"
 
+MACRO_ALLOC_POOL_ENTITY_IMPL(CStructure, CGameWorld::ENTTYPE_STRUCTURE)
+
 CStructure::CStructure(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_STRUCTURE)
 {
@@ -3,6 +3,8 @@
 
 class CStructure : public CEntity
 {
+	MACRO_ALLOC_POOL_ENTITY()
+
 public:
 	CStructure(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir);
 
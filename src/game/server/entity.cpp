@@ -20,11 +20,19 @@ CEntity::CEntity(CGameWorld *pGameWorld, int ObjType)
 
 	m_pPrevTypeEntity = 0;
 	m_pNextTypeEntity = 0;
+	m_pPrevGridEntity = 0;
+	m_pNextGridEntity = 0;
+	m_GridCell = -1;
+	m_InsertSerial = 0;
+
+	m_Pooled = false;
+	m_Handle = GameWorld()->NewHandle(this);
 }
 
 CEntity::~CEntity()
 {
 	GameWorld()->RemoveEntity(this);
+	GameWorld()->FreeHandle(m_Handle);
 	Server()->SnapFreeID(m_ID);
 }
 
@@ -35,22 +43,14 @@ int CEntity::NetworkClipped(int SnappingClient)
 
 int CEntity::NetworkClipped(int SnappingClient, vec2 CheckPos)
 {
+	// the shared snapshot clips the items per client later on
 	if(SnappingClient == -1)
+	{
+		GameServer()->m_SnapCache.ClipView(CheckPos);
 		return 0;
+	}
 
-	if(GameServer()->m_apPlayers[SnappingClient]->GetTeam() == TEAM_SPECTATORS)
-	    return 0;
-
-	float dx = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos.x-CheckPos.x;
-	float dy = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos.y-CheckPos.y;
-
-	if(absolute(dx) > 1000.0f || absolute(dy) > 800.0f)
-		return 1;
-
-	if(distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, CheckPos) > 1100.0f)
-		return 1;
-
-	return 0;
+	return GameServer()->NetworkClipped(SnappingClient, CheckPos);
 }
 
 bool CEntity::GameLayerClipped(vec2 CheckPos)
@@ -5,6 +5,7 @@
 
 #include <new>
 #include <base/vmath.h>
+#include <game/server/entitypool.h>
 #include <game/server/gameworld.h>
 
 #define MACRO_ALLOC_HEAP() \
@@ -50,6 +51,26 @@
 		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
 	}
 
+// entities that are created and destroyed a lot come from a CEntityPool
+#define MACRO_ALLOC_POOL_ENTITY() \
+	public: \
+	void *operator new(size_t Size); \
+	void operator delete(void *pPtr); \
+	private:
+
+#define MACRO_ALLOC_POOL_ENTITY_IMPL(POOLTYPE, Type) \
+	static CEntity *PoolSlotEntity##POOLTYPE(void *pSlot) { return (POOLTYPE *)pSlot; } \
+	static CEntityPool ms_EntityPool##POOLTYPE(sizeof(POOLTYPE), Type, PoolSlotEntity##POOLTYPE); \
+	void *POOLTYPE::operator new(size_t Size) \
+	{ \
+		dbg_assert(sizeof(POOLTYPE) == Size, "size error"); \
+		return ms_EntityPool##POOLTYPE.Allocate(); \
+	} \
+	void POOLTYPE::operator delete(void *pPtr) \
+	{ \
+		ms_EntityPool##POOLTYPE.Free(pPtr); \
+	}
+
 /*
 	Class: Entity
 		Basic entity class.
@@ -62,6 +83,15 @@ class CEntity
 	CEntity *m_pPrevTypeEntity;
 	CEntity *m_pNextTypeEntity;
 
+	// grid cell handling, m_GridCell is -1 when not in the grid
+	CEntity *m_pPrevGridEntity;
+	CEntity *m_pNextGridEntity;
+	int m_GridCell;
+	int64 m_InsertSerial; // 0 while not in the world
+
+	bool m_Pooled;
+	CEntityHandle m_Handle;
+
 	class CGameWorld *m_pGameWorld;
 protected:
 	bool m_MarkedForDestroy;
@@ -79,6 +109,13 @@ public:
 	CEntity *TypeNext() { return m_pNextTypeEntity; }
 	CEntity *TypePrev() { return m_pPrevTypeEntity; }
 
+	/*
+		Function: handle
+			Returns a handle to the entity, to keep a reference to it
+			that can be resolved with CGameWorld::GetEntity.
+	*/
+	CEntityHandle Handle() const { return m_Handle; }
+
 	/*
 		Function: destroy
 			Destorys the entity.
@@ -0,0 +1,96 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "entitypool.h"
+
+CEntityPool *CEntityPool::ms_pFirstPool = 0;
+
+CEntityPool::CEntityPool(int SlotSize, int Type, FSlotEntity pfnSlotEntity)
+{
+	m_NumChunks = 0;
+	m_FirstFree = -1;
+	m_NumUsed = 0;
+	m_SlotSize = SlotSize;
+	m_Type = Type;
+	m_pfnSlotEntity = pfnSlotEntity;
+
+	// keep the pools in the order they are made
+	m_pNextPool = 0;
+	CEntityPool **ppLink = &ms_pFirstPool;
+	while(*ppLink)
+		ppLink = &(*ppLink)->m_pNextPool;
+	*ppLink = this;
+}
+
+void CEntityPool::Grow()
+{
+	dbg_assert(m_NumChunks < MAX_CHUNKS, "entity pool is full");
+
+	CChunk *pChunk = (CChunk *)mem_alloc(sizeof(CChunk), 1);
+	pChunk->m_pData = (char *)mem_alloc(CHUNK_SLOTS*m_SlotSize, 1);
+
+	// link the new slots in memory order in front of the free list
+	int First = m_NumChunks*CHUNK_SLOTS;
+	for(int i = 0; i < CHUNK_SLOTS; i++)
+	{
+		pChunk->m_aNextFree[i] = i < CHUNK_SLOTS-1 ? First+i+1 : m_FirstFree;
+		pChunk->m_aUsed[i] = false;
+	}
+	m_apChunks[m_NumChunks++] = pChunk;
+	m_FirstFree = First;
+}
+
+void *CEntityPool::Allocate()
+{
+	if(m_FirstFree == -1)
+		Grow();
+
+	int Slot = m_FirstFree;
+	CChunk *pChunk = m_apChunks[Slot/CHUNK_SLOTS];
+	m_FirstFree = pChunk->m_aNextFree[Slot%CHUNK_SLOTS];
+	pChunk->m_aUsed[Slot%CHUNK_SLOTS] = true;
+	m_NumUsed++;
+
+	// the entities expect zeroed memory, like from MACRO_ALLOC_HEAP
+	void *pPtr = pChunk->m_pData + (Slot%CHUNK_SLOTS)*m_SlotSize;
+	mem_zero(pPtr, m_SlotSize);
+	return pPtr;
+}
+
+void CEntityPool::Free(void *pPtr)
+{
+	for(int i = 0; i < m_NumChunks; i++)
+	{
+		CChunk *pChunk = m_apChunks[i];
+		int Offset = (int)((char *)pPtr - pChunk->m_pData);
+		if((char *)pPtr < pChunk->m_pData || Offset >= CHUNK_SLOTS*m_SlotSize)
+			continue;
+
+		// freed slots are handed out first, their memory is still in the cache
+		int Index = Offset/m_SlotSize;
+		dbg_assert(pChunk->m_aUsed[Index], "entity pool slot not used");
+		pChunk->m_aUsed[Index] = false;
+		pChunk->m_aNextFree[Index] = m_FirstFree;
+		m_FirstFree = i*CHUNK_SLOTS+Index;
+		m_NumUsed--;
+		return;
+	}
+	dbg_assert(0, "entity not from this pool");
+}
+
+bool CEntityPool::Contains(const void *pPtr) const
+{
+	for(int i = 0; i < m_NumChunks; i++)
+		if((const char *)pPtr >= m_apChunks[i]->m_pData && (const char *)pPtr < m_apChunks[i]->m_pData+CHUNK_SLOTS*m_SlotSize)
+			return true;
+	return false;
+}
+
+CEntityPool *CEntityPool::FindPool(const void *pPtr)
+{
+	for(CEntityPool *pPool = ms_pFirstPool; pPool; pPool = pPool->m_pNextPool)
+		if(pPool->Contains(pPtr))
+			return pPool;
+	return 0;
+}
@@ -0,0 +1,75 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_ENTITYPOOL_H
+#define GAME_SERVER_ENTITYPOOL_H
+
+/*
+	Class: CEntityPool
+		Storage for the objects of one entity class. The objects live in
+		chunks of contiguous slots that are only allocated when the pool
+		grows, freed slots are kept on a free list and handed out again,
+		so spawning and destroying entities doesn't use the allocator.
+		All pools are linked together, which lets the world walk the
+		entities of a type in memory order.
+*/
+class CEntityPool
+{
+public:
+	typedef class CEntity *(*FSlotEntity)(void *pSlot);
+
+private:
+	enum
+	{
+		CHUNK_SLOTS=256,
+		MAX_CHUNKS=128,
+	};
+
+	struct CChunk
+	{
+		char *m_pData;
+		int m_aNextFree[CHUNK_SLOTS];
+		bool m_aUsed[CHUNK_SLOTS];
+	};
+
+	CChunk *m_apChunks[MAX_CHUNKS];
+	int m_NumChunks;
+	int m_FirstFree;
+	int m_NumUsed;
+
+	int m_SlotSize;
+	int m_Type;
+	FSlotEntity m_pfnSlotEntity;
+
+	CEntityPool *m_pNextPool;
+	static CEntityPool *ms_pFirstPool;
+
+	void Grow();
+
+public:
+	// pools are static objects, their memory is kept until the end
+	CEntityPool(int SlotSize, int Type, FSlotEntity pfnSlotEntity);
+
+	void *Allocate();
+	void Free(void *pPtr);
+	bool Contains(const void *pPtr) const;
+
+	// slots in memory order, 0 for unused ones
+	int NumSlots() const { return m_NumChunks*CHUNK_SLOTS; }
+	class CEntity *Get(int Slot) const
+	{
+		CChunk *pChunk = m_apChunks[Slot/CHUNK_SLOTS];
+		if(!pChunk->m_aUsed[Slot%CHUNK_SLOTS])
+			return 0;
+		return m_pfnSlotEntity(pChunk->m_pData + (Slot%CHUNK_SLOTS)*m_SlotSize);
+	}
+
+	int Type() const { return m_Type; }
+	int NumUsed() const { return m_NumUsed; }
+	int MemoryUsage() const { return m_NumChunks*(CHUNK_SLOTS*m_SlotSize+(int)sizeof(CChunk)); }
+
+	CEntityPool *NextPool() const { return m_pNextPool; }
+	static CEntityPool *FirstPool() { return ms_pFirstPool; }
+	static CEntityPool *FindPool(const void *pPtr);
+};
+
+#endif
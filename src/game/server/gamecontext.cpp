@@ -3,6 +3,7 @@
 #include <new>
 #include <base/math.h>
 #include <engine/shared/config.h>
+#include <engine/shared/profiler.h>
 #include <engine/map.h>
 #include <engine/console.h>
 #include "gamecontext.h"
@@ -49,7 +50,10 @@ void CGameContext::Construct(int Resetting)
 	m_LockTeams = 0;
 
 	if(Resetting==NO_RESET)
+	{
 		m_pVoteOptionHeap = new CHeap();
+		m_pPreloadedMap = 0;
+	}
 
 	m_SpecMuted = false;
 
@@ -74,12 +78,16 @@ CGameContext::~CGameContext()
 	for(int i = 0; i < MAX_CLIENTS; i++)
 		delete m_apPlayers[i];
 	if(!m_Resetting)
+	{
 		delete m_pVoteOptionHeap;
+		delete m_pPreloadedMap;
+	}
 }
 
 void CGameContext::Clear()
 {
 	CHeap *pVoteOptionHeap = m_pVoteOptionHeap;
+	CPreloadedMap *pPreloadedMap = m_pPreloadedMap;
 	CVoteOptionServer *pVoteOptionFirst = m_pVoteOptionFirst;
 	CVoteOptionServer *pVoteOptionLast = m_pVoteOptionLast;
 	int NumVoteOptions = m_NumVoteOptions;
@@ -91,6 +99,7 @@ void CGameContext::Clear()
 	new (this) CGameContext(RESET);
 
 	m_pVoteOptionHeap = pVoteOptionHeap;
+	m_pPreloadedMap = pPreloadedMap;
 	m_pVoteOptionFirst = pVoteOptionFirst;
 	m_pVoteOptionLast = pVoteOptionLast;
 	m_NumVoteOptions = NumVoteOptions;
@@ -207,7 +216,7 @@ void CGameContext::CreateDeath(vec2 Pos, int ClientID)
 	}
 }
 
-void CGameContext::CreateSound(vec2 Pos, int Sound, int Mask)
+void CGameContext::CreateSound(vec2 Pos, int Sound, CClientMask Mask)
 {
 	if (Sound < 0)
 		return;
@@ -256,7 +265,24 @@ void CGameContext::SendChatPrivate(int To, int ChatterClientID, int Team, const
 	Msg.m_Team = Team;
 	Msg.m_ClientID = ChatterClientID;
 	Msg.m_pMessage = pText;
-	Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, To);
+	SendChatMsg(&Msg, MSGFLAG_VITAL, To);
+}
+
+void CGameContext::SendChatMsg(const CNetMsg_Sv_Chat *pMsg, int Flags, int To)
+{
+	CNetMsg_Sv_Chat Msg = *pMsg;
+	char aBuf[256];
+	if(To >= 0 && m_apPlayers[To] && Msg.m_ClientID >= 0)
+	{
+		// a chatter without an id on that client is named in the message
+		Msg.m_ClientID = m_apPlayers[To]->m_IDMap.ToLocal(pMsg->m_ClientID);
+		if(Msg.m_ClientID == -1)
+		{
+			str_format(aBuf, sizeof(aBuf), "%s: %s", Server()->ClientName(pMsg->m_ClientID), pMsg->m_pMessage);
+			Msg.m_pMessage = aBuf;
+		}
+	}
+	Server()->SendPackMsg(&Msg, Flags, To);
 }
 
 
@@ -275,7 +301,17 @@ void CGameContext::SendChat(int ChatterClientID, int Team, const char *pText)
 		Msg.m_Team = 0;
 		Msg.m_ClientID = ChatterClientID;
 		Msg.m_pMessage = pText;
-		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
+		if(ChatterClientID < 0 || !IDsTranslated())
+			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
+		else
+		{
+			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
+			for(int i = 0; i < MAX_CLIENTS; i++)
+			{
+				if(m_apPlayers[i] && Server()->ClientIngame(i))
+					SendChatMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+			}
+		}
 	}
 	else
 	{
@@ -291,7 +327,7 @@ void CGameContext::SendChat(int ChatterClientID, int Team, const char *pText)
 		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
 			if(m_apPlayers[i] && m_apPlayers[i]->GetTeam() == Team)
-				Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+				SendChatMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
 		}
 	}
 }
@@ -301,7 +337,52 @@ void CGameContext::SendEmoticon(int ClientID, int Emoticon)
 	CNetMsg_Sv_Emoticon Msg;
 	Msg.m_ClientID = ClientID;
 	Msg.m_Emoticon = Emoticon;
-	Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
+	if(!IDsTranslated())
+	{
+		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
+		return;
+	}
+
+	// only the clients that know the player see the emoticon
+	Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(!m_apPlayers[i] || !Server()->ClientIngame(i))
+			continue;
+		Msg.m_ClientID = m_apPlayers[i]->m_IDMap.ToLocal(ClientID);
+		if(Msg.m_ClientID != -1)
+			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+	}
+}
+
+void CGameContext::SendKillMsg(int Killer, int Victim, int Weapon, int ModeSpecial)
+{
+	CNetMsg_Sv_KillMsg Msg;
+	Msg.m_Killer = Killer;
+	Msg.m_Victim = Victim;
+	Msg.m_Weapon = Weapon;
+	Msg.m_ModeSpecial = ModeSpecial;
+	if(!IDsTranslated())
+	{
+		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
+		return;
+	}
+
+	// clients that don't know the victim skip the message, an unknown
+	// killer is shown as the victim itself
+	Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(!m_apPlayers[i] || !Server()->ClientIngame(i))
+			continue;
+		Msg.m_Victim = m_apPlayers[i]->m_IDMap.ToLocal(Victim);
+		if(Msg.m_Victim == -1)
+			continue;
+		Msg.m_Killer = m_apPlayers[i]->m_IDMap.ToLocal(Killer);
+		if(Msg.m_Killer == -1)
+			Msg.m_Killer = Msg.m_Victim;
+		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+	}
 }
 
 void CGameContext::SendWeaponPickup(int ClientID, int Weapon)
@@ -444,15 +525,20 @@ void CGameContext::OnTick()
 
 	// copy tuning
 	m_World.m_Core.m_Tuning = m_Tuning;
+	m_Collision.RecordMoves(g_Config.m_DbgMoveTrace);
 	m_World.Tick();
 
 	//if(world.paused) // make sure that the game object always updates
-	m_pController->Tick();
+	{
+		CProfileScope Scope(CProfiler::SECTION_CONTROLLER);
+		m_pController->Tick();
+	}
 
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
 		if(m_apPlayers[i])
 		{
+			CProfileScope Scope(m_apPlayers[i]->m_isBot ? CProfiler::SECTION_BOTS : CProfiler::SECTION_PLAYERS, i);
 			m_apPlayers[i]->Tick();
 			m_apPlayers[i]->PostTick();
 		}
@@ -920,7 +1006,7 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 					}
 				}
 
-				int KickID = str_toint(pMsg->m_Value);
+				int KickID = pPlayer->m_IDMap.ToGlobal(str_toint(pMsg->m_Value));
 				if(KickID < 0 || KickID >= MAX_CLIENTS || !m_apPlayers[KickID])
 				{
 					SendChatTarget(ClientID, "Invalid client id to kick");
@@ -959,7 +1045,7 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 					return;
 				}
 
-				int SpectateID = str_toint(pMsg->m_Value);
+				int SpectateID = pPlayer->m_IDMap.ToGlobal(str_toint(pMsg->m_Value));
 				if(SpectateID < 0 || SpectateID >= MAX_CLIENTS || !m_apPlayers[SpectateID] || m_apPlayers[SpectateID]->GetTeam() == TEAM_SPECTATORS)
 				{
 					SendChatTarget(ClientID, "Invalid client id to move");
@@ -983,7 +1069,7 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 					return;
 				}
 
-				int MuteID = str_toint(pMsg->m_Value);
+				int MuteID = pPlayer->m_IDMap.ToGlobal(str_toint(pMsg->m_Value));
 				if(!IsValidCID(MuteID))
 				{
 					SendChatTarget(ClientID, "Invalid client id to mute");
@@ -1086,16 +1172,17 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 		else if (MsgID == NETMSGTYPE_CL_SETSPECTATORMODE && !m_World.m_Paused)
 		{
 			CNetMsg_Cl_SetSpectatorMode *pMsg = (CNetMsg_Cl_SetSpectatorMode *)pRawMsg;
+			int SpectatorID = pMsg->m_SpectatorID == SPEC_FREEVIEW ? SPEC_FREEVIEW : pPlayer->m_IDMap.ToGlobal(pMsg->m_SpectatorID);
 
-			if(pPlayer->GetTeam() != TEAM_SPECTATORS || pPlayer->m_SpectatorID == pMsg->m_SpectatorID || ClientID == pMsg->m_SpectatorID ||
+			if(pPlayer->GetTeam() != TEAM_SPECTATORS || pPlayer->m_SpectatorID == SpectatorID || ClientID == SpectatorID ||
 				(g_Config.m_SvSpamprotection && pPlayer->m_LastSetSpectatorMode && pPlayer->m_LastSetSpectatorMode+Server()->TickSpeed()*3 > Server()->Tick()))
 				return;
 
 			pPlayer->m_LastSetSpectatorMode = Server()->Tick();
-			if(pMsg->m_SpectatorID != SPEC_FREEVIEW && (!m_apPlayers[pMsg->m_SpectatorID] || m_apPlayers[pMsg->m_SpectatorID]->GetTeam() == TEAM_SPECTATORS))
+			if(pMsg->m_SpectatorID != SPEC_FREEVIEW && (SpectatorID == -1 || !m_apPlayers[SpectatorID] || m_apPlayers[SpectatorID]->GetTeam() == TEAM_SPECTATORS))
 				SendChatTarget(ClientID, "Invalid spectator id used");
 			else
-				pPlayer->m_SpectatorID = pMsg->m_SpectatorID;
+				pPlayer->m_SpectatorID = SpectatorID;
 		}
 		else if (MsgID == NETMSGTYPE_CL_CHANGEINFO)
 		{
@@ -1125,6 +1212,7 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 			pPlayer->m_TeeInfos.m_UseCustomColor = pMsg->m_UseCustomColor;
 			pPlayer->m_TeeInfos.m_ColorBody = pMsg->m_ColorBody;
 			pPlayer->m_TeeInfos.m_ColorFeet = pMsg->m_ColorFeet;
+			pPlayer->InvalidateClientInfo();
 			// m_pController->OnPlayerInfoChange(pPlayer);
 		}
 		else if (MsgID == NETMSGTYPE_CL_EMOTICON && !m_World.m_Paused)
@@ -1201,6 +1289,7 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 			pPlayer->m_TeeInfos.m_UseCustomColor = pMsg->m_UseCustomColor;
 			pPlayer->m_TeeInfos.m_ColorBody = pMsg->m_ColorBody;
 			pPlayer->m_TeeInfos.m_ColorFeet = pMsg->m_ColorFeet;
+			pPlayer->InvalidateClientInfo();
 			// m_pController->OnPlayerInfoChange(pPlayer);
 
 			// send vote options
@@ -1342,6 +1431,161 @@ void CGameContext::ConTuneDump(IConsole::IResult *pResult, void *pUserData)
 	}
 }
 
+void CGameContext::ConEntityPools(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	for(CEntityPool *pPool = CEntityPool::FirstPool(); pPool; pPool = pPool->NextPool())
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "type=%d used=%d slots=%d memory=%d", pPool->Type(), pPool->NumUsed(), pPool->NumSlots(), pPool->MemoryUsage());
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "entity", aBuf);
+	}
+}
+
+void CGameContext::ConCollisionBench(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	CCollision *pCollision = pSelf->Collision();
+	if(!pCollision->GetWidth())
+		return;
+	int Num = (pResult->NumArguments() ? clamp(pResult->GetInteger(0), 1, 100) : 10) * 1000000;
+
+	// random positions on the map and a bit around it
+	enum { NUM_POSITIONS=4096 };
+	static vec2 s_aPositions[NUM_POSITIONS];
+	float Width = pCollision->GetWidth()*32.0f;
+	float Height = pCollision->GetHeight()*32.0f;
+	for(int i = 0; i < NUM_POSITIONS; i++)
+		s_aPositions[i] = vec2(frandom()*(Width+256.0f)-128.0f, frandom()*(Height+256.0f)-128.0f);
+
+	int Mismatches = 0;
+	for(int i = 0; i < NUM_POSITIONS; i++)
+		if(pCollision->GetCollisionAt(s_aPositions[i].x, s_aPositions[i].y) != pCollision->GetCollisionAtReference(s_aPositions[i].x, s_aPositions[i].y))
+			Mismatches++;
+
+	int Sum = 0;
+	int64 Start = time_get();
+	for(int i = 0; i < Num; i++)
+		Sum += pCollision->GetCollisionAtReference(s_aPositions[i%NUM_POSITIONS].x, s_aPositions[i%NUM_POSITIONS].y);
+	int64 Reference = time_get()-Start;
+
+	Start = time_get();
+	for(int i = 0; i < Num; i++)
+		Sum += pCollision->GetCollisionAt(s_aPositions[i%NUM_POSITIONS].x, s_aPositions[i%NUM_POSITIONS].y);
+	int64 Current = time_get()-Start;
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "%d lookups: old %.1fM/s, new %.1fM/s, mismatches=%d (%d)", Num,
+		Num/(Reference/(float)time_freq())/1000000.0f, Num/(Current/(float)time_freq())/1000000.0f, Mismatches, Sum&1);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "collision", aBuf);
+
+	// the tile triggers of a tee against the corner checks they replace
+	Mismatches = 0;
+	for(int i = 0; i < NUM_POSITIONS; i++)
+	{
+		vec2 Pos = s_aPositions[i];
+		float Outer = CCharacter::ms_PhysSize / 3.f;
+		float Inner = CCharacter::ms_PhysSize / 100.f;
+		int Death = 0, Freeze = 0;
+		for(int c = 0; c < 4; c++)
+		{
+			float Dx = c&1 ? 1.0f : -1.0f;
+			float Dy = c&2 ? 1.0f : -1.0f;
+			Death |= pCollision->GetCollisionAt(Pos.x + Dx*Outer, Pos.y + Dy*Outer)&CCollision::COLFLAG_DEATH;
+			Freeze |= pCollision->GetCollisionAtNew(Pos.x + Dx*Inner, Pos.y + Dy*Inner) == TILE_FREEZE;
+		}
+		if((Death != 0) != ((pCollision->GetTriggers(Pos, Outer)&CCollision::TRIGGER_DEATH) != 0) ||
+			(Freeze != 0) != ((pCollision->GetTriggers(Pos, Inner)&CCollision::TRIGGER_FREEZE) != 0))
+			Mismatches++;
+	}
+	str_format(aBuf, sizeof(aBuf), "%d trigger lookups: mismatches=%d", NUM_POSITIONS, Mismatches);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "collision", aBuf);
+
+	// random lines up to laser length, compared against the reference
+	enum { NUM_LINES=NUM_POSITIONS/2 };
+	vec2 *pLines = s_aPositions;
+	for(int i = 0; i < NUM_LINES; i++)
+	{
+		float Length = frandom() < 0.5f ? frandom()*100.0f : frandom()*1500.0f;
+		float Angle = frandom()*2*pi;
+		pLines[i*2+1] = pLines[i*2] + vec2(cosf(Angle), sinf(Angle))*Length;
+	}
+
+	Mismatches = 0;
+	for(int i = 0; i < NUM_LINES; i++)
+	{
+		vec2 aOut[4];
+		int Hit = pCollision->IntersectLine(pLines[i*2], pLines[i*2+1], &aOut[0], &aOut[1]);
+		int HitReference = pCollision->IntersectLineReference(pLines[i*2], pLines[i*2+1], &aOut[2], &aOut[3]);
+		if(Hit != HitReference || !(aOut[0] == aOut[2]) || !(aOut[1] == aOut[3]))
+			Mismatches++;
+	}
+
+	int NumLines = Num/100;
+	Start = time_get();
+	for(int i = 0; i < NumLines; i++)
+		Sum += pCollision->IntersectLineReference(pLines[(i%NUM_LINES)*2], pLines[(i%NUM_LINES)*2+1], 0, 0);
+	Reference = time_get()-Start;
+
+	Start = time_get();
+	for(int i = 0; i < NumLines; i++)
+		Sum += pCollision->IntersectLine(pLines[(i%NUM_LINES)*2], pLines[(i%NUM_LINES)*2+1], 0, 0);
+	Current = time_get()-Start;
+
+	str_format(aBuf, sizeof(aBuf), "%d lines: old %.2fM/s, new %.2fM/s, mismatches=%d (%d)", NumLines,
+		NumLines/(Reference/(float)time_freq())/1000000.0f, NumLines/(Current/(float)time_freq())/1000000.0f, Mismatches, Sum&1);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "collision", aBuf);
+
+	// random tee moves, the velocities go up to ninja speed
+	enum { NUM_MOVES=NUM_POSITIONS/2 };
+	vec2 *pMoves = s_aPositions;
+	for(int i = 0; i < NUM_MOVES; i++)
+	{
+		float Speed = frandom() < 0.8f ? frandom()*20.0f : frandom()*80.0f;
+		float Angle = frandom()*2*pi;
+		pMoves[i*2+1] = vec2(cosf(Angle), sinf(Angle))*Speed;
+	}
+
+	Mismatches = 0;
+	for(int i = 0; i < NUM_MOVES; i++)
+	{
+		vec2 aPos[2] = {pMoves[i*2], pMoves[i*2]};
+		vec2 aVel[2] = {pMoves[i*2+1], pMoves[i*2+1]};
+		pCollision->MoveBox(&aPos[0], &aVel[0], vec2(28.0f, 28.0f), 0.0f);
+		pCollision->MoveBoxReference(&aPos[1], &aVel[1], vec2(28.0f, 28.0f), 0.0f);
+		if(mem_comp(&aPos[0], &aPos[1], sizeof(vec2)) != 0 || mem_comp(&aVel[0], &aVel[1], sizeof(vec2)) != 0)
+			Mismatches++;
+	}
+
+	int NumRecorded;
+	int RecordedMismatches = pCollision->CompareMoves(&NumRecorded);
+
+	int NumMoves = Num/100;
+	Start = time_get();
+	for(int i = 0; i < NumMoves; i++)
+	{
+		vec2 Pos = pMoves[(i%NUM_MOVES)*2];
+		vec2 Vel = pMoves[(i%NUM_MOVES)*2+1];
+		pCollision->MoveBoxReference(&Pos, &Vel, vec2(28.0f, 28.0f), 0.0f);
+		Sum += (int)Pos.x;
+	}
+	Reference = time_get()-Start;
+
+	Start = time_get();
+	for(int i = 0; i < NumMoves; i++)
+	{
+		vec2 Pos = pMoves[(i%NUM_MOVES)*2];
+		vec2 Vel = pMoves[(i%NUM_MOVES)*2+1];
+		pCollision->MoveBox(&Pos, &Vel, vec2(28.0f, 28.0f), 0.0f);
+		Sum += (int)Pos.x;
+	}
+	Current = time_get()-Start;
+
+	str_format(aBuf, sizeof(aBuf), "%d moves: old %.2fM/s, new %.2fM/s, mismatches=%d, recorded mismatches=%d/%d (%d)", NumMoves,
+		NumMoves/(Reference/(float)time_freq())/1000000.0f, NumMoves/(Current/(float)time_freq())/1000000.0f, Mismatches, RecordedMismatches, NumRecorded, Sum&1);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "collision", aBuf);
+}
+
 void CGameContext::ConPause(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
@@ -1873,6 +2117,18 @@ void CGameContext::ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *p
 	}
 }
 
+void CGameContext::ConchainBotSkinUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments())
+	{
+		CGameContext *pSelf = (CGameContext *)pUserData;
+		for(int i = 0; i < MAX_CLIENTS; ++i)
+			if(pSelf->m_apPlayers[i] && pSelf->m_apPlayers[i]->m_isBot)
+				pSelf->m_apPlayers[i]->InvalidateClientInfo();
+	}
+}
+
 void CGameContext::ConFreeze(IConsole::IResult *pResult, void *pUserData)   {
 	CGameContext *pSelf = (CGameContext *)pUserData;
 	int ClientID = pResult->GetInteger(0);
@@ -1924,12 +2180,16 @@ void CGameContext::ConSetName(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
 	pSelf->Server()->SetClientName(pResult->GetInteger(0), pResult->GetString(1));
+	if(pSelf->IsValidCID(pResult->GetInteger(0)))
+		pSelf->m_apPlayers[pResult->GetInteger(0)]->InvalidateClientInfo();
 }
 
 void CGameContext::ConSetClan(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
 	pSelf->Server()->SetClientClan(pResult->GetInteger(0), pResult->GetString(1));
+	if(pSelf->IsValidCID(pResult->GetInteger(0)))
+		pSelf->m_apPlayers[pResult->GetInteger(0)]->InvalidateClientInfo();
 }
 
 void CGameContext::ConKill(IConsole::IResult *pResult, void *pUserData)
@@ -2102,6 +2362,7 @@ void CGameContext::AddBot(int difficulty) {
 		type = 1;
 	OnClientConnected(id);
 	m_apPlayers[id]->m_isBot = type;
+	m_apPlayers[id]->InvalidateClientInfo();
 	OnClientEnter(id);
 	m_pServer->m_numberBots++;
 }
@@ -2133,6 +2394,8 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("tune", "s?i", CFGFLAG_SERVER, ConTuneParam, this, "Tune variable to value");
 	Console()->Register("tune_reset", "", CFGFLAG_SERVER, ConTuneReset, this, "Reset tuning");
 	Console()->Register("tune_dump", "", CFGFLAG_SERVER, ConTuneDump, this, "Dump tuning");
+	Console()->Register("entity_pools", "", CFGFLAG_SERVER, ConEntityPools, this, "Show the usage of the entity pools");
+	Console()->Register("collision_bench", "?i", CFGFLAG_SERVER, ConCollisionBench, this, "Measure collision lookups, line tests and moves per second, and compare them against the old code (millions of lookups)");
 
 	Console()->Register("pause", "", CFGFLAG_SERVER, ConPause, this, "Pause/unpause game");
 	Console()->Register("change_map", "?r", CFGFLAG_SERVER|CFGFLAG_STORE, ConChangeMap, this, "Change map");
@@ -2153,6 +2416,7 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("vote", "r", CFGFLAG_SERVER, ConVote, this, "Force a vote to yes/no");
 
 	Console()->Chain("sv_motd", ConchainSpecialMotdupdate, this);
+	Console()->Chain("sv_bot_skin", ConchainBotSkinUpdate, this);
 
 	Console()->Register("freeze", "ii", CFGFLAG_SERVER, ConFreeze, this, "Freeze a player for x seconds");
 	Console()->Register("unfreeze", "i", CFGFLAG_SERVER, ConUnFreeze, this, "Unfreeze a player");
@@ -2181,13 +2445,20 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 	m_pConsole = Kernel()->RequestInterface<IConsole>();
 	m_World.SetGameServer(this);
 	m_Events.SetGameServer(this);
+	m_SnapCache.SetGameServer(this);
 	m_Mute.Init(this);
 
 	for(int i = 0; i < NUM_NETOBJTYPES; i++)
 		Server()->SnapSetStaticsize(i, m_NetObjHandler.GetObjSize(i));
 
+	// the collision arrays and the entities of the map were normally
+	// built by the map job already
 	m_Layers.Init(Kernel());
-	m_Collision.Init(&m_Layers);
+	if(m_pPreloadedMap)
+		m_Collision.TakeOver(&m_pPreloadedMap->m_Collision, &m_Layers);
+	else
+		m_Collision.Init(&m_Layers);
+	m_World.InitGrid(m_Collision.GetWidth(), m_Collision.GetHeight());
 
 	m_pServer->m_numberBots = 0; // reset bot count
 
@@ -2200,19 +2471,28 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 	else
 		m_pController = new CGameControllerUNKNOWN(this);
 
-	CMapItemLayerTilemap *pTileMap = m_Layers.GameLayer();
-	CTile *pTiles = (CTile *)Kernel()->RequestInterface<IMap>()->GetData(pTileMap->m_Data);
-
-	for(int y = 0; y < pTileMap->m_Height; y++)
+	if(m_pPreloadedMap)
 	{
-		for(int x = 0; x < pTileMap->m_Width; x++)
-		{
-			int Index = pTiles[y*pTileMap->m_Width+x].m_Index;
+		for(int i = 0; i < m_pPreloadedMap->m_NumEntities; i++)
+			m_pController->OnEntity(m_pPreloadedMap->m_pEntities[i].m_Index, m_pPreloadedMap->m_pEntities[i].m_Pos);
+		OnMapPreloadDiscard();
+	}
+	else
+	{
+		CMapItemLayerTilemap *pTileMap = m_Layers.GameLayer();
+		CTile *pTiles = (CTile *)Kernel()->RequestInterface<IMap>()->GetData(pTileMap->m_Data);
 
-			if(Index >= ENTITY_OFFSET)
+		for(int y = 0; y < pTileMap->m_Height; y++)
+		{
+			for(int x = 0; x < pTileMap->m_Width; x++)
 			{
-				vec2 Pos(x*32.0f+16.0f, y*32.0f+16.0f);
-				m_pController->OnEntity(Index-ENTITY_OFFSET, Pos);
+				int Index = pTiles[y*pTileMap->m_Width+x].m_Index;
+
+				if(Index >= ENTITY_OFFSET)
+				{
+					vec2 Pos(x*32.0f+16.0f, y*32.0f+16.0f);
+					m_pController->OnEntity(Index-ENTITY_OFFSET, Pos);
+				}
 			}
 		}
 	}
@@ -2249,72 +2529,233 @@ void CGameContext::OnShutdown()
 	Clear();
 }
 
-void CGameContext::OnSnap(int ClientID)
+bool CGameContext::OnMapPreload(IMap *pMap)
 {
-	// make sure vanilla clients don't crash if there are more than 16 tees online possible
-	bool actuallySnap = true;
-	if (g_Config.m_SvMaxClients <= VANILLA_MAX_CLIENTS)
-		actuallySnap = true;
-	else {
-		IServer::CClientInfo Info;
-		int infoExists = Server()->GetClientInfo(ClientID, &Info);
-		int ddnetversion = Info.m_DDNetVersion;
-		if (infoExists && ddnetversion > VERSION_DDNET_WHISPER)
-			actuallySnap = true;
-		else
-			actuallySnap = false;
+	// only touches the new map and m_pPreloadedMap, the game keeps running
+	// on the old map. the main thread leaves both alone until the job is done
+	OnMapPreloadDiscard();
+
+	CPreloadedMap *pPreloaded = new CPreloadedMap;
+	pPreloaded->m_Layers.Init(pMap);
+	CMapItemLayerTilemap *pTileMap = pPreloaded->m_Layers.GameLayer();
+	CTile *pTiles = pTileMap ? (CTile *)pMap->GetData(pTileMap->m_Data) : 0;
+	if(!pTiles)
+	{
+		delete pPreloaded;
+		return false;
 	}
 
-	if (actuallySnap) {
-		// add tuning to demo
-		CTuningParams StandardTuning;
-		if(ClientID == -1 && Server()->DemoRecorder_IsRecording() && mem_comp(&StandardTuning, &m_Tuning, sizeof(CTuningParams)) != 0)
+	pPreloaded->m_Collision.Init(&pPreloaded->m_Layers);
+
+	// gather the entity tiles, the controller that spawns them is made in OnInit
+	int NumEntities = 0;
+	for(int i = 0; i < pTileMap->m_Width*pTileMap->m_Height; i++)
+		if(pTiles[i].m_Index >= ENTITY_OFFSET)
+			NumEntities++;
+	if(NumEntities)
+		pPreloaded->m_pEntities = (CPreloadedMap::CEntityTile *)mem_alloc(NumEntities*sizeof(CPreloadedMap::CEntityTile), 1);
+	for(int y = 0; y < pTileMap->m_Height; y++)
+		for(int x = 0; x < pTileMap->m_Width; x++)
 		{
-			CMsgPacker Msg(NETMSGTYPE_SV_TUNEPARAMS);
-			int *pParams = (int *)&m_Tuning;
-			for(unsigned i = 0; i < sizeof(m_Tuning)/sizeof(int); i++)
-				Msg.AddInt(pParams[i]);
-			Server()->SendMsg(&Msg, MSGFLAG_RECORD|MSGFLAG_NOSEND, ClientID);
+			int Index = pTiles[y*pTileMap->m_Width+x].m_Index;
+			if(Index >= ENTITY_OFFSET)
+			{
+				CPreloadedMap::CEntityTile *pEntity = &pPreloaded->m_pEntities[pPreloaded->m_NumEntities++];
+				pEntity->m_Index = Index-ENTITY_OFFSET;
+				pEntity->m_Pos = vec2(x*32.0f+16.0f, y*32.0f+16.0f);
+			}
 		}
 
-		m_World.Snap(ClientID);
-		m_pController->Snap(ClientID);
-		m_Events.Snap(ClientID);
+	m_pPreloadedMap = pPreloaded;
+	return true;
+}
 
+void CGameContext::OnMapPreloadDiscard()
+{
+	delete m_pPreloadedMap;
+	m_pPreloadedMap = 0;
+}
 
-		for(int i = 0; i < MAX_CLIENTS; i++)
+bool CGameContext::NetworkClipped(int SnappingClient, vec2 CheckPos)
+{
+	if(m_apPlayers[SnappingClient]->GetTeam() == TEAM_SPECTATORS)
+	    return false;
+
+	float dx = m_apPlayers[SnappingClient]->m_ViewPos.x-CheckPos.x;
+	float dy = m_apPlayers[SnappingClient]->m_ViewPos.y-CheckPos.y;
+
+	if(absolute(dx) > 1000.0f || absolute(dy) > 800.0f)
+		return true;
+
+	if(distance(m_apPlayers[SnappingClient]->m_ViewPos, CheckPos) > 1100.0f)
+		return true;
+
+	return false;
+}
+
+void CGameContext::SnapItems(int SnappingClient)
+{
+	m_World.Snap(SnappingClient);
+	m_SnapCache.BeginGroup();
+	m_pController->Snap(SnappingClient);
+	m_Events.Snap(SnappingClient);
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_apPlayers[i])
+			m_apPlayers[i]->Snap(SnappingClient);
+	}
+
+	m_SnapCache.BeginGroup();
+	// WARNING, this is very hardcoded; for ddnet client support
+	// This object needs to be snapped alongside pDDNetCharacter for that object to work properly
+	int *pUuidItem = (int *)Server()->SnapNewItem(0, 32764, 16); // NETOBJTYPE_EX
+	if(pUuidItem)
+	{
+		pUuidItem[0] = 1993229659;
+		pUuidItem[1] = -102024632;
+		pUuidItem[2] = -1378361269;
+		pUuidItem[3] = -1810037668;
+	}
+	// This object needs to be snapped alongside pDDNetPlayer for that object to work properly
+	int *pUuidItemP = (int *)Server()->SnapNewItem(0, 32765, 16); // NETOBJTYPE_EX
+	if(pUuidItemP)
+	{
+		pUuidItemP[0] = 583701389;
+		pUuidItemP[1] = 327171627;
+		pUuidItemP[2] = -1636052395;
+		pUuidItemP[3] = -1901674991;
+	}
+}
+
+void CGameContext::OnSnap(int ClientID)
+{
+	// add tuning to demo
+	CTuningParams StandardTuning;
+	if(ClientID == -1 && Server()->DemoRecorder_IsRecording() && mem_comp(&StandardTuning, &m_Tuning, sizeof(CTuningParams)) != 0)
+	{
+		CMsgPacker Msg(NETMSGTYPE_SV_TUNEPARAMS);
+		int *pParams = (int *)&m_Tuning;
+		for(unsigned i = 0; i < sizeof(m_Tuning)/sizeof(int); i++)
+			Msg.AddInt(pParams[i]);
+		Server()->SendMsg(&Msg, MSGFLAG_RECORD|MSGFLAG_NOSEND, ClientID);
+	}
+
+	// the ids are only translated by the snap cache, without the shared
+	// snapshot a client that needs it gets a cache of its own view
+	if(m_SnapCache.Valid())
+		m_SnapCache.Snap(ClientID);
+	else if(ClientID != -1 && m_apPlayers[ClientID] && !m_apPlayers[ClientID]->m_IDMap.Identity())
+	{
+		m_SnapCache.Begin(ClientID);
+		SnapItems(ClientID);
+		m_SnapCache.End();
+		m_SnapCache.Snap(ClientID);
+		m_SnapCache.Invalidate();
+	}
+	else
+		SnapItems(ClientID);
+}
+
+void CGameContext::OnPreSnap()
+{
+	UpdateIDMaps();
+
+	// snap everything once for no client in particular, OnSnap only
+	// filters these items and patches the per client fields
+	if(!g_Config.m_SvSnapShared)
+		return;
+
+	m_SnapCache.Begin();
+	SnapItems(-1);
+	m_SnapCache.End();
+}
+
+int CGameContext::NumClientIDs(int ClientID)
+{
+	// 0 if all slots fit into the ids of the client
+	IServer::CClientInfo Info;
+	int NumIDs = VANILLA_MAX_CLIENTS;
+	if(Server()->GetClientInfo(ClientID, &Info) && Info.m_DDNetVersion > VERSION_DDNET_WHISPER)
+		NumIDs = LEGACY_MAX_CLIENTS;
+	return Server()->MaxClients() > NumIDs ? NumIDs : 0;
+}
+
+bool CGameContext::IDsTranslated()
+{
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		if(m_apPlayers[i] && !m_apPlayers[i]->m_IDMap.Identity())
+			return true;
+	return false;
+}
+
+void CGameContext::UpdateIDMaps()
+{
+	// gather the players once, all maps are built from it
+	CClientMask Present;
+	vec2 aPos[MAX_CLIENTS];
+	int aHooked[MAX_CLIENTS];
+	bool NeedMaps = false;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		aHooked[i] = -1;
+		if(!m_apPlayers[i] || !Server()->ClientIngame(i))
+			continue;
+
+		if(m_apPlayers[i]->m_isBot)
+		{
+			if(!m_apPlayers[i]->m_IDMap.Identity())
+				m_apPlayers[i]->m_IDMap.Init(i, 0);
+		}
+		else
 		{
-			if(m_apPlayers[i])
-				m_apPlayers[i]->Snap(ClientID);
+			int NumIDs = NumClientIDs(i);
+			if(NumIDs != m_apPlayers[i]->m_IDMap.NumIDs())
+				m_apPlayers[i]->m_IDMap.Init(i, NumIDs);
+			NeedMaps = NeedMaps || NumIDs;
 		}
 
-		// WARNING, this is very hardcoded; for ddnet client support
-		// This object needs to be snapped alongside pDDNetCharacter for that object to work properly
-		int *pUuidItem = (int *)Server()->SnapNewItem(0, 32764, 16); // NETOBJTYPE_EX
-		if(pUuidItem)
+		Present.Set(i);
+		CCharacter *pChr = m_apPlayers[i]->GetCharacter();
+		if(pChr && pChr->IsAlive())
 		{
-			pUuidItem[0] = 1993229659;
-			pUuidItem[1] = -102024632;
-			pUuidItem[2] = -1378361269;
-			pUuidItem[3] = -1810037668;
+			aPos[i] = pChr->m_Pos;
+			aHooked[i] = pChr->GetCore()->m_HookedPlayer;
 		}
-		// This object needs to be snapped alongside pDDNetPlayer for that object to work properly
-		int *pUuidItemP = (int *)Server()->SnapNewItem(0, 32765, 16); // NETOBJTYPE_EX
-		if(pUuidItemP)
+		else
+			aPos[i] = vec2(1e10f, 1e10f);
+	}
+	if(!NeedMaps)
+		return;
+
+	// the own player, the spectated one and the hook partners come first,
+	// the others by their distance to the view
+	float aScores[MAX_CLIENTS];
+	for(int i = Present.Next(0); i != -1; i = Present.Next(i+1))
+	{
+		CPlayer *pPlayer = m_apPlayers[i];
+		if(pPlayer->m_IDMap.Identity())
+			continue;
+
+		int SpectatorID = pPlayer->GetTeam() == TEAM_SPECTATORS ? pPlayer->m_SpectatorID : SPEC_FREEVIEW;
+		for(int j = Present.Next(0); j != -1; j = Present.Next(j+1))
 		{
-			pUuidItemP[0] = 583701389;
-			pUuidItemP[1] = 327171627;
-			pUuidItemP[2] = -1636052395;
-			pUuidItemP[3] = -1901674991;
+			if(j == i)
+				aScores[j] = -2.0f;
+			else if(j == SpectatorID || aHooked[i] == j || aHooked[j] == i)
+				aScores[j] = -1.0f;
+			else
+			{
+				vec2 Diff = aPos[j]-pPlayer->m_ViewPos;
+				float Score = Diff.x*Diff.x+Diff.y*Diff.y;
+				aScores[j] = Score == Score ? Score : 1e30f;
+			}
 		}
-	} else {
-		// snap only own tee so the ddnet client version is still given
-		m_apPlayers[ClientID]->Snap(ClientID);
+		pPlayer->m_IDMap.Update(aScores, Present, Server()->Tick());
 	}
 }
 
-void CGameContext::OnPreSnap() {}
-void CGameContext::OnPostSnap() {   	m_Events.Clear();   }
+void CGameContext::OnPostSnap() {   	m_Events.Clear(); m_SnapCache.Invalidate();   }
 bool CGameContext::IsClientReady(int ClientID)  {	return m_apPlayers[ClientID] && m_apPlayers[ClientID]->m_IsReady ? true : false;    }
 bool CGameContext::IsClientPlayer(int ClientID) {	return m_apPlayers[ClientID] && m_apPlayers[ClientID]->GetTeam() == TEAM_SPECTATORS ? false : true; }
 const char *CGameContext::GameType() { return m_pController && m_pController->m_pGameType ? m_pController->m_pGameType : ""; }
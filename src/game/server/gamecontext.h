@@ -7,6 +7,7 @@
 #include <engine/console.h>
 #include <engine/shared/memheap.h>
 
+#include <game/collision.h>
 #include <game/layers.h>
 #include <game/voting.h>
 //#include <string>
@@ -16,6 +17,7 @@
 #include "gameworld.h"
 #include "player.h"
 #include "mute.h"
+#include "snapcache.h"
 //#include "entities/character.h"
 
 
@@ -41,6 +43,24 @@
 
 */
 
+// what OnMapPreload builds for the next map on the map job, OnInit takes it over
+struct CPreloadedMap
+{
+	struct CEntityTile
+	{
+		int m_Index;
+		vec2 m_Pos;
+	};
+
+	CLayers m_Layers;
+	CCollision m_Collision;
+	CEntityTile *m_pEntities;
+	int m_NumEntities;
+
+	CPreloadedMap() : m_pEntities(0), m_NumEntities(0) {}
+	~CPreloadedMap() { if(m_pEntities) mem_free(m_pEntities); }
+};
+
 class CGameContext : public IGameServer
 {
 	IServer *m_pServer;
@@ -56,6 +76,8 @@ class CGameContext : public IGameServer
 	static void ConTuneParam(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneReset(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneDump(IConsole::IResult *pResult, void *pUserData);
+	static void ConCollisionBench(IConsole::IResult *pResult, void *pUserData);
+	static void ConEntityPools(IConsole::IResult *pResult, void *pUserData);
 	static void ConPause(IConsole::IResult *pResult, void *pUserData);
 	static void ConChangeMap(IConsole::IResult *pResult, void *pUserData);
 	static void ConRestart(IConsole::IResult *pResult, void *pUserData);
@@ -73,6 +95,7 @@ class CGameContext : public IGameServer
 	static void ConClearVotes(IConsole::IResult *pResult, void *pUserData);
 	static void ConVote(IConsole::IResult *pResult, void *pUserData);
 	static void ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
+	static void ConchainBotSkinUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 
 	static void ConFreeze(IConsole::IResult *pResult, void *pUserData);
 	static void ConUnFreeze(IConsole::IResult *pResult, void *pUserData);
@@ -113,6 +136,7 @@ public:
 	void Clear();
 
 	CEventHandler m_Events;
+	CSnapCache m_SnapCache;
 	CPlayer *m_apPlayers[MAX_CLIENTS];
 
 	IGameController *m_pController;
@@ -121,6 +145,13 @@ public:
 	// helper functions
 	class CCharacter *GetPlayerChar(int ClientID);
 	inline bool IsValidCID(int CID) { return (CID >= 0) && (CID < MAX_CLIENTS) && m_apPlayers[CID]; }
+	bool NetworkClipped(int SnappingClient, vec2 CheckPos);
+	void SnapItems(int SnappingClient);
+
+	// clients with fewer ids than there are slots get the player ids translated
+	int NumClientIDs(int ClientID);
+	bool IDsTranslated();
+	void UpdateIDMaps();
 
 	int m_LockTeams;
 
@@ -154,6 +185,7 @@ public:
 		VOTE_ENFORCE_YES,
 	};
 	CHeap *m_pVoteOptionHeap;
+	CPreloadedMap *m_pPreloadedMap;
 	CVoteOptionServer *m_pVoteOptionFirst;
 	CVoteOptionServer *m_pVoteOptionLast;
 
@@ -163,7 +195,7 @@ public:
 	void CreateHammerHit(vec2 Pos);
 	void CreatePlayerSpawn(vec2 Pos);
 	void CreateDeath(vec2 Pos, int Who);
-	void CreateSound(vec2 Pos, int Sound, int Mask=-1);
+	void CreateSound(vec2 Pos, int Sound, CClientMask Mask=CmaskAll());
 	void CreateSoundGlobal(int Sound, int Target=-1);
 
 
@@ -183,7 +215,9 @@ public:
 	void SendChatTarget(int To, const char *pText);
 	void SendChatPrivate(int To, int ChatterClientID, int Team, const char *pText);
 	void SendChat(int ClientID, int Team, const char *pText);
+	void SendChatMsg(const CNetMsg_Sv_Chat *pMsg, int Flags, int To);
 	void SendEmoticon(int ClientID, int Emoticon);
+	void SendKillMsg(int Killer, int Victim, int Weapon, int ModeSpecial);
 	void SendWeaponPickup(int ClientID, int Weapon);
 	void SendBroadcast(const char *pText, int ClientID);
 
@@ -199,6 +233,8 @@ public:
 	virtual void OnInit();
 	virtual void OnConsoleInit();
 	virtual void OnShutdown();
+	virtual bool OnMapPreload(class IMap *pMap);
+	virtual void OnMapPreloadDiscard();
 
 	virtual void OnTick();
 	virtual void OnPreSnap();
@@ -229,8 +265,4 @@ public:
 	bool CheckForCapslock(const char *pStr);
 };
 
-inline int CmaskAll() { return -1; }
-inline int CmaskOne(int ClientID) { return 1<<ClientID; }
-inline int CmaskAllExceptOne(int ClientID) { return 0x7fffffff^CmaskOne(ClientID); }
-inline bool CmaskIsSet(int Mask, int ClientID) { return (Mask&CmaskOne(ClientID)) != 0; }
 #endif
@@ -15,6 +15,11 @@
 #include <string>
 #include <game/collision.h>
 
+// the default tile behaviour
+static void TriggerDeath(CCharacter *pChr, void *pUser) { pChr->DieOnTile(); }
+static void TriggerUnfreeze(CCharacter *pChr, void *pUser) { pChr->Melt(); }
+static void TriggerFreeze(CCharacter *pChr, void *pUser) { pChr->Freeze(3); }
+
 IGameController::IGameController(class CGameContext *pGameServer)
 {
 	m_pGameServer = pGameServer;
@@ -45,6 +50,16 @@ IGameController::IGameController(class CGameContext *pGameServer)
 	m_aNumSpawnPoints[2] = 0;
 
 	m_FakeWarmup = 0;
+
+	m_HandledTriggers = 0;
+	for(int i = 0; i < CCollision::NUM_TRIGGERS; i++)
+	{
+		m_aTriggerHandlers[i].m_pfnCallback = 0;
+		m_aTriggerHandlers[i].m_pUser = 0;
+	}
+	RegisterTrigger(CCollision::TRIGGER_DEATH, TriggerDeath, 0);
+	RegisterTrigger(CCollision::TRIGGER_UNFREEZE, TriggerUnfreeze, 0);
+	RegisterTrigger(CCollision::TRIGGER_FREEZE, TriggerFreeze, 0);
 }
 
 IGameController::~IGameController()
@@ -496,6 +511,32 @@ void IGameController::PostReset()
 // }
 
 
+void IGameController::RegisterTrigger(int Trigger, FTriggerCallback pfnCallback, void *pUser)
+{
+	for(int i = 0; i < CCollision::NUM_TRIGGERS; i++)
+	{
+		if(Trigger != 1<<i)
+			continue;
+
+		m_aTriggerHandlers[i].m_pfnCallback = pfnCallback;
+		m_aTriggerHandlers[i].m_pUser = pUser;
+		if(pfnCallback)
+			m_HandledTriggers |= Trigger;
+		else
+			m_HandledTriggers &= ~Trigger;
+	}
+}
+
+void IGameController::HandleTriggers(CCharacter *pChr, int Triggers)
+{
+	Triggers &= m_HandledTriggers;
+	for(int i = 0; Triggers; i++, Triggers >>= 1)
+	{
+		if(Triggers&1)
+			m_aTriggerHandlers[i].m_pfnCallback(pChr, m_aTriggerHandlers[i].m_pUser);
+	}
+}
+
 int IGameController::OnCharacterDeath(class CCharacter *pVictim, class CPlayer *pKiller, int Weapon)
 {
 	// do scoreing
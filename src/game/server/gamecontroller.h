@@ -4,6 +4,7 @@
 #define GAME_SERVER_GAMECONTROLLER_H
 
 #include <base/vmath.h>
+#include <game/collision.h>
 #include <stdio.h>
 //#include <string>
 
@@ -14,6 +15,10 @@
 */
 class IGameController
 {
+public:
+	typedef void (*FTriggerCallback)(class CCharacter *pChr, void *pUser);
+
+private:
 	vec2 m_aaSpawnPoints[3][64];
 	int m_aNumSpawnPoints[3];
 
@@ -62,6 +67,14 @@ protected:
 	int m_UnbalancedTick;
 	bool m_ForceBalanced;
 
+	struct CTriggerHandler
+	{
+		FTriggerCallback m_pfnCallback;
+		void *m_pUser;
+	};
+	CTriggerHandler m_aTriggerHandlers[CCollision::NUM_TRIGGERS];
+	int m_HandledTriggers;
+
 	//std::string m_playerNames[16]; // MAX_CLIENTS
 
 public:
@@ -133,6 +146,25 @@ public:
 	*/
 	virtual int OnCharacterDeath(class CCharacter *pVictim, class CPlayer *pKiller, int Weapon);
 
+	/*
+		Function: RegisterTrigger
+			Sets the function called for a character that touches a tile
+			with the trigger, replacing the previous one. Gamemodes use
+			this in their constructor to add or change tile behaviour.
+
+		Arguments:
+			trigger - One of the CCollision::TRIGGER_* bits.
+			callback - The function to call, 0 to ignore the trigger.
+	*/
+	void RegisterTrigger(int Trigger, FTriggerCallback pfnCallback, void *pUser);
+
+	/*
+		Function: HandleTriggers
+			Calls the registered functions for the triggers a character
+			touches this tick, in the order of the trigger bits.
+	*/
+	void HandleTriggers(class CCharacter *pChr, int Triggers);
+
 
 
 	// virtual void OnPlayerInfoChange(class CPlayer *pP);
@@ -1,6 +1,8 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
+#include <engine/shared/profiler.h>
+
 #include "gameworld.h"
 #include "entity.h"
 #include "gamecontext.h"
@@ -17,6 +19,31 @@ CGameWorld::CGameWorld()
 	m_ResetRequested = false;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
 		m_apFirstEntityTypes[i] = 0;
+	m_InsertSerial = 0;
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		m_aNumUnpooled[i] = 0;
+
+	static const char *s_apSectionNames[NUM_ENTTYPES] = {"projectiles", "lasers", "pickups", "flags", "characters", "structures"};
+	dbg_assert(CProfiler::SECTION_WORLD+NUM_ENTTYPES-1 <= CProfiler::SECTION_WORLD_LAST, "too many entity types for the profiler");
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		g_Profiler.SetName(CProfiler::SECTION_WORLD+i, s_apSectionNames[i]);
+
+	m_TraverseType = 0;
+	m_TraverseSerial = 0;
+	m_pTraversePool = 0;
+	m_TraverseSlot = -1;
+	m_TraverseList = false;
+
+	m_apHandleEntities = 0;
+	m_pHandleGenerations = 0;
+	m_pHandleNextFree = 0;
+	m_NumHandles = 0;
+	m_FirstFreeHandle = -1;
+
+	m_apGrid = 0;
+	m_GridWidth = 0;
+	m_GridHeight = 0;
+	m_GridMaxRadius = 0.0f;
 }
 
 CGameWorld::~CGameWorld()
@@ -25,6 +52,124 @@ CGameWorld::~CGameWorld()
 	for(int i = 0; i < NUM_ENTTYPES; i++)
 		while(m_apFirstEntityTypes[i])
 			delete m_apFirstEntityTypes[i];
+
+	if(m_apGrid)
+		mem_free(m_apGrid);
+	if(m_apHandleEntities)
+	{
+		mem_free(m_apHandleEntities);
+		mem_free(m_pHandleGenerations);
+		mem_free(m_pHandleNextFree);
+	}
+}
+
+CEntityHandle CGameWorld::NewHandle(CEntity *pEnt)
+{
+	if(m_FirstFreeHandle == -1)
+	{
+		// double the table, the new indices go on the free list
+		int NumHandles = max(256, m_NumHandles*2);
+		CEntity **apEntities = (CEntity **)mem_alloc(NumHandles*sizeof(CEntity *), 1);
+		int *pGenerations = (int *)mem_alloc(NumHandles*sizeof(int), 1);
+		int *pNextFree = (int *)mem_alloc(NumHandles*sizeof(int), 1);
+		if(m_apHandleEntities)
+		{
+			mem_copy(apEntities, m_apHandleEntities, m_NumHandles*sizeof(CEntity *));
+			mem_copy(pGenerations, m_pHandleGenerations, m_NumHandles*sizeof(int));
+			mem_copy(pNextFree, m_pHandleNextFree, m_NumHandles*sizeof(int));
+			mem_free(m_apHandleEntities);
+			mem_free(m_pHandleGenerations);
+			mem_free(m_pHandleNextFree);
+		}
+		for(int i = m_NumHandles; i < NumHandles; i++)
+		{
+			apEntities[i] = 0;
+			pGenerations[i] = 0;
+			pNextFree[i] = i < NumHandles-1 ? i+1 : -1;
+		}
+		m_FirstFreeHandle = m_NumHandles;
+		m_apHandleEntities = apEntities;
+		m_pHandleGenerations = pGenerations;
+		m_pHandleNextFree = pNextFree;
+		m_NumHandles = NumHandles;
+	}
+
+	CEntityHandle Handle;
+	Handle.m_Index = m_FirstFreeHandle;
+	Handle.m_Generation = m_pHandleGenerations[Handle.m_Index];
+	m_FirstFreeHandle = m_pHandleNextFree[Handle.m_Index];
+	m_apHandleEntities[Handle.m_Index] = pEnt;
+	return Handle;
+}
+
+void CGameWorld::FreeHandle(CEntityHandle Handle)
+{
+	if(Handle.IsNull() || m_apHandleEntities[Handle.m_Index] == 0)
+		return;
+
+	m_apHandleEntities[Handle.m_Index] = 0;
+	m_pHandleGenerations[Handle.m_Index]++;
+	m_pHandleNextFree[Handle.m_Index] = m_FirstFreeHandle;
+	m_FirstFreeHandle = Handle.m_Index;
+}
+
+CEntity *CGameWorld::GetEntity(CEntityHandle Handle, int Type)
+{
+	if(Handle.m_Index < 0 || Handle.m_Index >= m_NumHandles || m_pHandleGenerations[Handle.m_Index] != Handle.m_Generation)
+		return 0;
+	CEntity *pEnt = m_apHandleEntities[Handle.m_Index];
+	if(!pEnt || (Type != -1 && pEnt->m_ObjType != Type))
+		return 0;
+	return pEnt;
+}
+
+bool CGameWorld::Traversable(CEntity *pEnt) const
+{
+	return pEnt->m_InsertSerial != 0 && pEnt->m_InsertSerial <= m_TraverseSerial;
+}
+
+CEntity *CGameWorld::TraverseFirst(int Type)
+{
+	m_TraverseType = Type;
+	m_TraverseSerial = m_InsertSerial;
+	m_pTraversePool = CEntityPool::FirstPool();
+	m_TraverseSlot = -1;
+	m_TraverseList = false;
+	return TraverseNext();
+}
+
+CEntity *CGameWorld::TraverseNext()
+{
+	// the pools of the type first
+	while(m_pTraversePool)
+	{
+		if(m_pTraversePool->Type() == m_TraverseType)
+		{
+			while(++m_TraverseSlot < m_pTraversePool->NumSlots())
+			{
+				CEntity *pEnt = m_pTraversePool->Get(m_TraverseSlot);
+				if(pEnt && Traversable(pEnt))
+					return pEnt;
+			}
+		}
+		m_pTraversePool = m_pTraversePool->NextPool();
+		m_TraverseSlot = -1;
+	}
+
+	// then the entities that were allocated elsewhere
+	if(!m_TraverseList)
+	{
+		m_TraverseList = true;
+		m_pNextTraverseEntity = m_aNumUnpooled[m_TraverseType] ? m_apFirstEntityTypes[m_TraverseType] : 0;
+	}
+	while(m_pNextTraverseEntity)
+	{
+		CEntity *pEnt = m_pNextTraverseEntity;
+		m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+		if(!pEnt->m_Pooled && Traversable(pEnt))
+			return pEnt;
+	}
+	return 0;
 }
 
 void CGameWorld::SetGameServer(CGameContext *pGameServer)
@@ -33,12 +178,140 @@ void CGameWorld::SetGameServer(CGameContext *pGameServer)
 	m_pServer = m_pGameServer->Server();
 }
 
+void CGameWorld::InitGrid(int Width, int Height)
+{
+	dbg_assert(!m_apGrid, "grid already initialized");
+
+	m_GridWidth = max(1, (Width+GRID_CELL_TILES-1)/GRID_CELL_TILES);
+	m_GridHeight = max(1, (Height+GRID_CELL_TILES-1)/GRID_CELL_TILES);
+	m_apGrid = (CEntity **)mem_alloc(m_GridWidth*m_GridHeight*sizeof(CEntity *), 1);
+	mem_zero(m_apGrid, m_GridWidth*m_GridHeight*sizeof(CEntity *));
+
+	// pick up the entities that were inserted before
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		if(IsGridType(i))
+			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+				GridInsert(pEnt);
+}
+
+int CGameWorld::GridCoord(float Value, int Size) const
+{
+	if(!(Value > 0.0f))
+		return 0;
+	if(Value >= Size*(float)GRID_CELL_SIZE)
+		return Size-1;
+	return (int)(Value/GRID_CELL_SIZE);
+}
+
+void CGameWorld::GridInsert(CEntity *pEnt)
+{
+	int Cell = GridCoord(pEnt->m_Pos.y, m_GridHeight)*m_GridWidth + GridCoord(pEnt->m_Pos.x, m_GridWidth);
+	pEnt->m_GridCell = Cell;
+	pEnt->m_pPrevGridEntity = 0;
+	pEnt->m_pNextGridEntity = m_apGrid[Cell];
+	if(m_apGrid[Cell])
+		m_apGrid[Cell]->m_pPrevGridEntity = pEnt;
+	m_apGrid[Cell] = pEnt;
+
+	m_GridMaxRadius = max(m_GridMaxRadius, pEnt->m_ProximityRadius);
+}
+
+void CGameWorld::GridRemove(CEntity *pEnt)
+{
+	if(pEnt->m_GridCell == -1)
+		return;
+
+	if(pEnt->m_pPrevGridEntity)
+		pEnt->m_pPrevGridEntity->m_pNextGridEntity = pEnt->m_pNextGridEntity;
+	else
+		m_apGrid[pEnt->m_GridCell] = pEnt->m_pNextGridEntity;
+	if(pEnt->m_pNextGridEntity)
+		pEnt->m_pNextGridEntity->m_pPrevGridEntity = pEnt->m_pPrevGridEntity;
+
+	pEnt->m_pPrevGridEntity = 0;
+	pEnt->m_pNextGridEntity = 0;
+	pEnt->m_GridCell = -1;
+}
+
+void CGameWorld::UpdateEntityPos(CEntity *pEnt)
+{
+	if(pEnt->m_GridCell == -1)
+		return;
+
+	int Cell = GridCoord(pEnt->m_Pos.y, m_GridHeight)*m_GridWidth + GridCoord(pEnt->m_Pos.x, m_GridWidth);
+	if(Cell != pEnt->m_GridCell)
+	{
+		GridRemove(pEnt);
+		GridInsert(pEnt);
+	}
+}
+
+int CGameWorld::GridQuery(vec2 Min, vec2 Max, CEntity **ppEnts, int MaxEnts)
+{
+	int x0 = GridCoord(Min.x, m_GridWidth);
+	int y0 = GridCoord(Min.y, m_GridHeight);
+	int x1 = GridCoord(Max.x, m_GridWidth);
+	int y1 = GridCoord(Max.y, m_GridHeight);
+
+	int Num = 0;
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(CEntity *pEnt = m_apGrid[y*m_GridWidth+x]; pEnt && Num < MaxEnts; pEnt = pEnt->m_pNextGridEntity)
+				ppEnts[Num++] = pEnt;
+
+	// same order as the entity lists, newest first
+	for(int i = 1; i < Num; i++)
+	{
+		CEntity *pEnt = ppEnts[i];
+		int j = i;
+		for(; j > 0 && ppEnts[j-1]->m_InsertSerial < pEnt->m_InsertSerial; j--)
+			ppEnts[j] = ppEnts[j-1];
+		ppEnts[j] = pEnt;
+	}
+
+	return Num;
+}
+
 CEntity *CGameWorld::FindFirst(int Type)
 {
 	return Type < 0 || Type >= NUM_ENTTYPES ? 0 : m_apFirstEntityTypes[Type];
 }
 
 int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
+{
+	if(Type < 0 || Type >= NUM_ENTTYPES)
+		return 0;
+	if(!m_apGrid || !IsGridType(Type))
+		return FindEntitiesReference(Pos, Radius, ppEnts, Max, Type);
+
+	CEntity *apCandidates[MAX_GRID_QUERY];
+	float Range = Radius+m_GridMaxRadius+1.0f;
+	int NumCandidates = GridQuery(Pos-vec2(Range, Range), Pos+vec2(Range, Range), apCandidates, MAX_GRID_QUERY);
+
+	int Num = 0;
+	for(int i = 0; i < NumCandidates && Num != Max; i++)
+	{
+		CEntity *pEnt = apCandidates[i];
+		if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
+		{
+			if(ppEnts)
+				ppEnts[Num] = pEnt;
+			Num++;
+		}
+	}
+
+	if(g_Config.m_DbgWorldGrid)
+	{
+		CEntity *apCheck[MAX_GRID_QUERY];
+		int NumCheck = FindEntitiesReference(Pos, Radius, apCheck, min(Max, (int)MAX_GRID_QUERY), Type);
+		if(NumCheck != Num || (ppEnts && mem_comp(apCheck, ppEnts, Num*sizeof(CEntity *)) != 0))
+			dbg_msg("gameworld", "grid mismatch in FindEntities. pos=%.1f,%.1f radius=%.1f num=%d expected=%d", Pos.x, Pos.y, Radius, Num, NumCheck);
+	}
+
+	return Num;
+}
+
+int CGameWorld::FindEntitiesReference(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
 {
 	if(Type < 0 || Type >= NUM_ENTTYPES)
 		return 0;
@@ -72,6 +345,16 @@ void CGameWorld::InsertEntity(CEntity *pEnt)
 	pEnt->m_pNextTypeEntity = m_apFirstEntityTypes[pEnt->m_ObjType];
 	pEnt->m_pPrevTypeEntity = 0x0;
 	m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt;
+	pEnt->m_InsertSerial = ++m_InsertSerial;
+
+	CEntityPool *pPool = CEntityPool::FindPool(pEnt);
+	dbg_assert(!pPool || pPool->Type() == pEnt->m_ObjType, "entity pool of the wrong type");
+	pEnt->m_Pooled = pPool != 0;
+	if(!pEnt->m_Pooled)
+		m_aNumUnpooled[pEnt->m_ObjType]++;
+
+	if(m_apGrid && IsGridType(pEnt->m_ObjType))
+		GridInsert(pEnt);
 }
 
 void CGameWorld::DestroyEntity(CEntity *pEnt)
@@ -81,6 +364,8 @@ void CGameWorld::DestroyEntity(CEntity *pEnt)
 
 void CGameWorld::RemoveEntity(CEntity *pEnt)
 {
+	GridRemove(pEnt);
+
 	// not in the list
 	if(!pEnt->m_pNextTypeEntity && !pEnt->m_pPrevTypeEntity && m_apFirstEntityTypes[pEnt->m_ObjType] != pEnt)
 		return;
@@ -99,17 +384,19 @@ void CGameWorld::RemoveEntity(CEntity *pEnt)
 
 	pEnt->m_pNextTypeEntity = 0;
 	pEnt->m_pPrevTypeEntity = 0;
+	pEnt->m_InsertSerial = 0;
+	if(!pEnt->m_Pooled)
+		m_aNumUnpooled[pEnt->m_ObjType]--;
 }
 
 //
 void CGameWorld::Snap(int SnappingClient)
 {
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+		for(CEntity *pEnt = TraverseFirst(i); pEnt; pEnt = TraverseNext())
 		{
-			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+			GameServer()->m_SnapCache.BeginGroup();
 			pEnt->Snap(SnappingClient);
-			pEnt = m_pNextTraverseEntity;
 		}
 }
 
@@ -156,33 +443,35 @@ void CGameWorld::Tick()
 	{
 		if(GameServer()->m_pController->IsForceBalanced())
 			GameServer()->SendChat(-1, CGameContext::CHAT_ALL, "Teams have been balanced");
+		// the characters only move through their cores from here on
+		m_Core.BuildBroadphase();
+
 		// update all objects
 		for(int i = 0; i < NUM_ENTTYPES; i++)
-			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
-			{
-				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+		{
+			CProfileScope Scope(CProfiler::SECTION_WORLD+i);
+			for(CEntity *pEnt = TraverseFirst(i); pEnt; pEnt = TraverseNext())
 				pEnt->Tick();
-				pEnt = m_pNextTraverseEntity;
-			}
+		}
 
 		for(int i = 0; i < NUM_ENTTYPES; i++)
-			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
-			{
-				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+		{
+			CProfileScope Scope(CProfiler::SECTION_WORLD+i);
+			for(CEntity *pEnt = TraverseFirst(i); pEnt; pEnt = TraverseNext())
 				pEnt->TickDefered();
-				pEnt = m_pNextTraverseEntity;
-			}
+		}
+
+		m_Core.InvalidateBroadphase();
 	}
 	else
 	{
 		// update all objects
 		for(int i = 0; i < NUM_ENTTYPES; i++)
-			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
-			{
-				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+		{
+			CProfileScope Scope(CProfiler::SECTION_WORLD+i);
+			for(CEntity *pEnt = TraverseFirst(i); pEnt; pEnt = TraverseNext())
 				pEnt->TickPaused();
-				pEnt = m_pNextTraverseEntity;
-			}
+		}
 	}
 
 	RemoveEntities();
@@ -191,6 +480,90 @@ void CGameWorld::Tick()
 
 // TODO: should be more general
 CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, vec2& NewPos, CEntity *pNotThis)
+{
+	if(!m_apGrid)
+		return IntersectCharacterReference(Pos0, Pos1, Radius, NewPos, pNotThis);
+
+	CEntity *apCandidates[MAX_GRID_QUERY];
+	float Range = Radius+m_GridMaxRadius+1.0f;
+	vec2 Min = vec2(min(Pos0.x, Pos1.x)-Range, min(Pos0.y, Pos1.y)-Range);
+	vec2 Max = vec2(max(Pos0.x, Pos1.x)+Range, max(Pos0.y, Pos1.y)+Range);
+	int NumCandidates = GridQuery(Min, Max, apCandidates, MAX_GRID_QUERY);
+
+	// Find other players, the candidates are in list order so ties resolve the same way
+	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
+	CCharacter *pClosest = 0;
+	vec2 ClosestPos = NewPos;
+
+	for(int i = 0; i < NumCandidates; i++)
+	{
+		CCharacter *p = (CCharacter *)apCandidates[i];
+		if(p == pNotThis)
+			continue;
+
+		vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
+		float Len = distance(p->m_Pos, IntersectPos);
+		if(Len < p->m_ProximityRadius+Radius)
+		{
+			Len = distance(Pos0, IntersectPos);
+			if(Len < ClosestLen)
+			{
+				ClosestPos = IntersectPos;
+				ClosestLen = Len;
+				pClosest = p;
+			}
+		}
+	}
+
+	if(g_Config.m_DbgWorldGrid)
+	{
+		vec2 CheckPos = NewPos;
+		CCharacter *pCheck = IntersectCharacterReference(Pos0, Pos1, Radius, CheckPos, pNotThis);
+		if(pCheck != pClosest || (pCheck && !(CheckPos == ClosestPos)))
+			dbg_msg("gameworld", "grid mismatch in IntersectCharacter. from=%.1f,%.1f to=%.1f,%.1f radius=%.1f", Pos0.x, Pos0.y, Pos1.x, Pos1.y, Radius);
+	}
+
+	NewPos = ClosestPos;
+	return pClosest;
+}
+
+CCharacter *CGameWorld::ClosestCharacter(vec2 Pos, float Radius, CEntity *pNotThis)
+{
+	if(!m_apGrid)
+		return ClosestCharacterReference(Pos, Radius, pNotThis);
+
+	CEntity *apCandidates[MAX_GRID_QUERY];
+	float Range = Radius+m_GridMaxRadius+1.0f;
+	int NumCandidates = GridQuery(Pos-vec2(Range, Range), Pos+vec2(Range, Range), apCandidates, MAX_GRID_QUERY);
+
+	// Find other players
+	float ClosestRange = Radius*2;
+	CCharacter *pClosest = 0;
+
+	for(int i = 0; i < NumCandidates; i++)
+	{
+		CCharacter *p = (CCharacter *)apCandidates[i];
+		if(p == pNotThis)
+			continue;
+
+		float Len = distance(Pos, p->m_Pos);
+		if(Len < p->m_ProximityRadius+Radius)
+		{
+			if(Len < ClosestRange)
+			{
+				ClosestRange = Len;
+				pClosest = p;
+			}
+		}
+	}
+
+	if(g_Config.m_DbgWorldGrid && ClosestCharacterReference(Pos, Radius, pNotThis) != pClosest)
+		dbg_msg("gameworld", "grid mismatch in ClosestCharacter. pos=%.1f,%.1f radius=%.1f", Pos.x, Pos.y, Radius);
+
+	return pClosest;
+}
+
+CCharacter *CGameWorld::IntersectCharacterReference(vec2 Pos0, vec2 Pos1, float Radius, vec2& NewPos, CEntity *pNotThis)
 {
 	// Find other players
 	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
@@ -220,13 +593,13 @@ CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, v
 }
 
 
-CCharacter *CGameWorld::ClosestCharacter(vec2 Pos, float Radius, CEntity *pNotThis)
+CCharacter *CGameWorld::ClosestCharacterReference(vec2 Pos, float Radius, CEntity *pNotThis)
 {
 	// Find other players
 	float ClosestRange = Radius*2;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)GameServer()->m_World.FindFirst(ENTTYPE_CHARACTER);
+	CCharacter *p = (CCharacter *)FindFirst(ENTTYPE_CHARACTER);
 	for(; p; p = (CCharacter *)p->TypeNext())
  	{
 		if(p == pNotThis)
@@ -7,6 +7,21 @@
 
 class CEntity;
 class CCharacter;
+class CEntityPool;
+
+/*
+	Struct: CEntityHandle
+		Reference to an entity that stays safe to keep after the entity
+		is gone, CGameWorld::GetEntity returns 0 for it then.
+*/
+struct CEntityHandle
+{
+	int m_Index;
+	int m_Generation;
+
+	CEntityHandle() : m_Index(-1), m_Generation(0) {}
+	bool IsNull() const { return m_Index == -1; }
+};
 
 /*
 	Class: Game World
@@ -27,12 +42,62 @@ public:
 		NUM_ENTTYPES
 	};
 
+	enum
+	{
+		// the grid cells are GRID_CELL_TILES tiles wide
+		GRID_CELL_TILES = 8,
+		GRID_CELL_SIZE = GRID_CELL_TILES*32,
+		MAX_GRID_QUERY = MAX_CLIENTS,
+	};
+
 private:
+	friend class CEntity; // handle handling
+
 	void Reset();
 	void RemoveEntities();
 
 	CEntity *m_pNextTraverseEntity;
 	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
+	int m_aNumUnpooled[NUM_ENTTYPES];
+	int64 m_InsertSerial;
+
+	// walks the entities of a type that were in the world when it
+	// started, the pooled ones in memory order and the others in list
+	// order. entities removed meanwhile are skipped
+	int m_TraverseType;
+	int64 m_TraverseSerial;
+	CEntityPool *m_pTraversePool;
+	int m_TraverseSlot;
+	bool m_TraverseList;
+	CEntity *TraverseFirst(int Type);
+	CEntity *TraverseNext();
+	bool Traversable(CEntity *pEnt) const;
+
+	// the entities by handle index, the generation of an index changes
+	// every time it is freed
+	CEntity **m_apHandleEntities;
+	int *m_pHandleGenerations;
+	int *m_pHandleNextFree;
+	int m_NumHandles;
+	int m_FirstFreeHandle;
+	CEntityHandle NewHandle(CEntity *pEnt);
+	void FreeHandle(CEntityHandle Handle);
+
+	// spatial grid of the characters, the only entities queried by position
+	CEntity **m_apGrid;
+	int m_GridWidth;
+	int m_GridHeight;
+	float m_GridMaxRadius;
+
+	static bool IsGridType(int Type) { return Type == ENTTYPE_CHARACTER; }
+	void GridInsert(CEntity *pEnt);
+	void GridRemove(CEntity *pEnt);
+	int GridQuery(vec2 Min, vec2 Max, CEntity **ppEnts, int MaxEnts);
+
+	// full searches over the entity lists, used to cross check the grid
+	int FindEntitiesReference(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type);
+	class CCharacter *IntersectCharacterReference(vec2 Pos0, vec2 Pos1, float Radius, vec2 &NewPos, class CEntity *pNotThis);
+	class CCharacter *ClosestCharacterReference(vec2 Pos, float Radius, CEntity *pNotThis);
 
 	class CGameContext *m_pGameServer;
 	class IServer *m_pServer;
@@ -50,8 +115,46 @@ public:
 
 	void SetGameServer(CGameContext *pGameServer);
 
+	/*
+		Function: init_grid
+			Sets up the spatial grid for a map.
+
+		Arguments:
+			width - Width of the map in tiles.
+			height - Height of the map in tiles.
+	*/
+	void InitGrid(int Width, int Height);
+
+	/*
+		Function: update_entity_pos
+			Has to be called after the position of an entity in the
+			world changed, to keep the spatial grid up to date.
+
+		Arguments:
+			entity - Entity that moved
+	*/
+	void UpdateEntityPos(CEntity *pEnt);
+
+	// grid geometry, positions outside of the map go to the border cells
+	int GridWidth() const { return m_GridWidth; }
+	int GridHeight() const { return m_GridHeight; }
+	int GridCoord(float Value, int Size) const;
+
 	CEntity *FindFirst(int Type);
 
+	/*
+		Function: get_entity
+			Resolves an entity handle.
+
+		Arguments:
+			handle - Handle from CEntity::Handle.
+			type - Type the entity has to be of, -1 for any type.
+
+		Returns:
+			The entity or NULL if it doesn't exist anymore.
+	*/
+	CEntity *GetEntity(CEntityHandle Handle, int Type = -1);
+
 	/*
 		Function: find_entities
 			Finds entities close to a position and returns them in a list.
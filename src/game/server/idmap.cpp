@@ -0,0 +1,115 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include "idmap.h"
+
+// moves the Num entries with the lowest scores to the front
+static void SelectLowest(int *pIDs, float *pScores, int Size, int Num)
+{
+	int k = Num-1;
+	int Lo = 0;
+	int Hi = Size-1;
+	while(Lo < Hi)
+	{
+		float Pivot = pScores[(Lo+Hi)/2];
+		int i = Lo;
+		int j = Hi;
+		while(i <= j)
+		{
+			while(pScores[i] < Pivot)
+				i++;
+			while(pScores[j] > Pivot)
+				j--;
+			if(i <= j)
+			{
+				int TmpID = pIDs[i]; pIDs[i] = pIDs[j]; pIDs[j] = TmpID;
+				float TmpScore = pScores[i]; pScores[i] = pScores[j]; pScores[j] = TmpScore;
+				i++;
+				j--;
+			}
+		}
+
+		if(k <= j)
+			Hi = j;
+		else if(k >= i)
+			Lo = i;
+		else
+			break;
+	}
+}
+
+CIDMap::CIDMap()
+{
+	Init(-1, 0);
+}
+
+void CIDMap::Init(int ClientID, int NumIDs)
+{
+	m_NumIDs = NumIDs;
+	m_Self = ClientID;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		m_aToLocal[i] = -1;
+		m_aToGlobal[i] = -1;
+		m_aFreeTick[i] = -1;
+	}
+
+	// the own player always has the first id
+	if(m_NumIDs && m_Self >= 0)
+	{
+		m_aToLocal[m_Self] = 0;
+		m_aToGlobal[0] = m_Self;
+	}
+}
+
+void CIDMap::Update(const float *pScores, const CClientMask &Present, int Tick)
+{
+	if(m_NumIDs == 0)
+		return;
+
+	// mapped players are favoured a bit, so they don't flicker at the border
+	int aIDs[MAX_CLIENTS];
+	float aScores[MAX_CLIENTS];
+	int Num = 0;
+	for(int i = Present.Next(0); i != -1; i = Present.Next(i+1))
+	{
+		aIDs[Num] = i;
+		aScores[Num] = m_aToLocal[i] != -1 && pScores[i] > 0 ? pScores[i]*0.64f : pScores[i];
+		Num++;
+	}
+	if(Num > m_NumIDs)
+	{
+		SelectLowest(aIDs, aScores, Num, m_NumIDs);
+		Num = m_NumIDs;
+	}
+
+	CClientMask Selected;
+	for(int i = 0; i < Num; i++)
+		Selected.Set(aIDs[i]);
+	if(m_Self >= 0)
+		Selected.Set(m_Self);
+
+	for(int l = 0; l < m_NumIDs; l++)
+	{
+		int ClientID = m_aToGlobal[l];
+		if(ClientID != -1 && !Selected.IsSet(ClientID))
+		{
+			m_aToLocal[ClientID] = -1;
+			m_aToGlobal[l] = -1;
+			m_aFreeTick[l] = Tick;
+		}
+	}
+
+	int Free = 0;
+	for(int i = 0; i < Num; i++)
+	{
+		if(m_aToLocal[aIDs[i]] != -1)
+			continue;
+
+		while(Free < m_NumIDs && (m_aToGlobal[Free] != -1 || m_aFreeTick[Free] == Tick))
+			Free++;
+		if(Free == m_NumIDs)
+			break;
+		m_aToLocal[aIDs[i]] = Free;
+		m_aToGlobal[Free] = aIDs[i];
+	}
+}
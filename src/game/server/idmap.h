@@ -0,0 +1,52 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_IDMAP_H
+#define GAME_SERVER_IDMAP_H
+
+#include "clientmask.h"
+
+/*
+	Class: CIDMap
+		Maps the client ids of the server to the smaller id space of one
+		client. Vanilla clients only know 16 ids and older ddnet clients 64,
+		so with more slots each of them gets the most relevant players
+		mapped to its ids and doesn't see the others. The ids handed out
+		are kept as long as the player stays relevant.
+*/
+class CIDMap
+{
+	int m_NumIDs; // 0 when the ids are used as they are
+	int m_Self;
+	int m_aToLocal[MAX_CLIENTS];
+	int m_aToGlobal[MAX_CLIENTS];
+	int m_aFreeTick[MAX_CLIENTS];
+
+public:
+	CIDMap();
+
+	// NumIDs 0 maps every id to itself
+	void Init(int ClientID, int NumIDs);
+	bool Identity() const { return m_NumIDs == 0; }
+	int NumIDs() const { return m_NumIDs; }
+
+	// -1 if the id has no mapping
+	int ToLocal(int ClientID) const
+	{
+		if(m_NumIDs == 0)
+			return ClientID;
+		return ClientID >= 0 && ClientID < MAX_CLIENTS ? m_aToLocal[ClientID] : -1;
+	}
+	int ToGlobal(int LocalID) const
+	{
+		if(m_NumIDs == 0)
+			return LocalID;
+		return LocalID >= 0 && LocalID < m_NumIDs ? m_aToGlobal[LocalID] : -1;
+	}
+
+	// maps the NumIDs present clients with the lowest scores. a freed
+	// id is only handed out again in a later tick, so the client doesn't
+	// take the new player for the old one
+	void Update(const float *pScores, const CClientMask &Present, int Tick);
+};
+
+#endif
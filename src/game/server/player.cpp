@@ -21,6 +21,7 @@ CPlayer::CPlayer(CGameContext *pGameServer, int ClientID, int Team)
 	m_ClientID = ClientID;
 	m_Team = GameServer()->m_pController->ClampTeam(Team);
 	m_SpectatorID = SPEC_FREEVIEW;
+	m_IDMap.Init(ClientID, GameServer()->NumClientIDs(ClientID));
 	m_LastActionTick = Server()->Tick();
 	m_TeamChangeTick = Server()->Tick();
 
@@ -45,6 +46,8 @@ CPlayer::CPlayer(CGameContext *pGameServer, int ClientID, int Team)
 	m_botAggro = -1;
 
 	m_Anonymous = false;
+	m_ClientInfoValid = false;
+	m_ClientInfoBomb = false;
 	// m_Invincible = false;
 
 	m_WantsPause = false;
@@ -271,6 +274,13 @@ void CPlayer::Snap(int SnappingClient)  {
 	if(!Server()->ClientIngame(m_ClientID))
 		return;
 
+	// latency is patched in per client, unless it's a fixed one
+	GameServer()->m_SnapCache.BeginGroup(m_ClientID, !m_Anonymous && !m_isBot);
+
+	bool Bomb = GetCharacter() && m_pCharacter->m_BombTick > 0;
+	if(!m_ClientInfoValid || m_ClientInfoBomb != Bomb)
+		UpdateClientInfo(Bomb);
+
 	CNetObj_ClientInfo *pClientInfo = static_cast<CNetObj_ClientInfo *>(Server()->SnapNewItem(NETOBJTYPE_CLIENTINFO, m_ClientID, sizeof(CNetObj_ClientInfo)));
 	CNetObj_PlayerInfo *pPlayerInfo = static_cast<CNetObj_PlayerInfo *>(Server()->SnapNewItem(NETOBJTYPE_PLAYERINFO, m_ClientID, sizeof(CNetObj_PlayerInfo)));
 	// CNetObj_DDNetPlayer *pDDNetPlayer = (CNetObj_DDNetPlayer *)Server()->SnapNewItem(NETOBJTYPE_DDNETPLAYER, m_ClientID, sizeof(CNetObj_DDNetPlayer));
@@ -290,48 +300,55 @@ void CPlayer::Snap(int SnappingClient)  {
     pPlayerInfo->m_Team = m_Team;
 
 
+	mem_copy(pClientInfo, &m_ClientInfo, sizeof(m_ClientInfo));
+
+	if(m_Anonymous) {
+        pPlayerInfo->m_Latency = 999;
+        pPlayerInfo->m_Score = GameServer()->m_pController->m_pTimeScore ? -9999 : 0;
+	} else {
+	    pPlayerInfo->m_Latency = SnappingClient == -1 ? m_Latency.m_Min : GameServer()->m_apPlayers[SnappingClient]->m_aActLatency[m_ClientID];
+		if(Bomb) // ######## CHECK IF BOMB OR ZOMBIE
+		    pPlayerInfo->m_Score = (m_pCharacter->m_BombTick / SERVER_TICK_SPEED)+1;
+        else
+            pPlayerInfo->m_Score = m_Score;//GameServer()->Server()->Tick() / SERVER_TICK_SPEED*100 - m_ClientID;//m_Score;
+	}
+
+	if(m_ClientID == SnappingClient)
+		SnapSpectatorInfo();
+
+	if (m_isBot) {
+		pPlayerInfo->m_Score = GameServer()->m_pController->m_pTimeScore ? -9999 : 0;
+		pPlayerInfo->m_Latency = 0;
+	}
+}
+
+void CPlayer::UpdateClientInfo(bool Bomb)
+{
+	// the strings are encoded here once, not for every snapshot
+	CNetObj_ClientInfo *pClientInfo = &m_ClientInfo;
+	mem_zero(pClientInfo, sizeof(*pClientInfo));
 	if(m_Anonymous) {
-	    // ######## CLIENT INFO
 	    StrToInts(&pClientInfo->m_Name0, 4, " "); StrToInts(&pClientInfo->m_Clan0, 3, " ");
         StrToInts(&pClientInfo->m_Skin0, 6, "default"); pClientInfo->m_UseCustomColor = false;
         pClientInfo->m_Country = -1;
-        // ######## PLAYER INFO
-        pPlayerInfo->m_Latency = 999;
-        pPlayerInfo->m_Score = GameServer()->m_pController->m_pTimeScore ? -9999 : 0;
 	} else {
-	    // ######## CLIENT INFO
         StrToInts(&pClientInfo->m_Name0, 4, Server()->ClientName(m_ClientID));
     	StrToInts(&pClientInfo->m_Clan0, 3, Server()->ClientClan(m_ClientID));
         pClientInfo->m_Country = Server()->ClientCountry(m_ClientID);
        	pClientInfo->m_ColorBody = m_TeeInfos.m_ColorBody;
        	pClientInfo->m_ColorFeet = m_TeeInfos.m_ColorFeet;
-        if(GetCharacter() && m_pCharacter->m_BombTick > 0) {// ######## CHECK IF BOMB OR ZOMBIE
+        if(Bomb) {// ######## CHECK IF BOMB OR ZOMBIE
        	    StrToInts(&pClientInfo->m_Skin0, 6, "bomb");
             pClientInfo->m_UseCustomColor = false;
         } else {
             StrToInts(&pClientInfo->m_Skin0, 6, m_TeeInfos.m_SkinName);
            	pClientInfo->m_UseCustomColor = m_TeeInfos.m_UseCustomColor;
         }
-        // ######## PLAYER INFO
-	    pPlayerInfo->m_Latency = SnappingClient == -1 ? m_Latency.m_Min : GameServer()->m_apPlayers[SnappingClient]->m_aActLatency[m_ClientID];
-		if(GetCharacter() && m_pCharacter->m_BombTick > 0) // ######## CHECK IF BOMB OR ZOMBIE
-		    pPlayerInfo->m_Score = (m_pCharacter->m_BombTick / SERVER_TICK_SPEED)+1;
-        else
-            pPlayerInfo->m_Score = m_Score;//GameServer()->Server()->Tick() / SERVER_TICK_SPEED*100 - m_ClientID;//m_Score;
-	}
-
-	if((m_ClientID == SnappingClient && m_Team == TEAM_SPECTATORS))	{
-		CNetObj_SpectatorInfo *pSpectatorInfo = static_cast<CNetObj_SpectatorInfo *>(Server()->SnapNewItem(NETOBJTYPE_SPECTATORINFO, m_ClientID, sizeof(CNetObj_SpectatorInfo)));
-		if(!pSpectatorInfo)	return;
-		pSpectatorInfo->m_SpectatorID = m_SpectatorID;
-		pSpectatorInfo->m_X = m_ViewPos.x;
-		pSpectatorInfo->m_Y = m_ViewPos.y;
 	}
 
 	if (m_isBot) {
 		StrToInts(&pClientInfo->m_Name0, 4, "bot");
 		StrToInts(&pClientInfo->m_Clan0, 3, "bot");
-		pPlayerInfo->m_Score = GameServer()->m_pController->m_pTimeScore ? -9999 : 0;
 		switch (m_isBot)	{
     		case 4: StrToInts(&pClientInfo->m_Clan0, 3, "bot4"); break;
     		case 5: StrToInts(&pClientInfo->m_Clan0, 3, "bot5"); break;
@@ -339,8 +356,21 @@ void CPlayer::Snap(int SnappingClient)  {
 		    default: break;
 		}
 		StrToInts(&pClientInfo->m_Skin0, 6, g_Config.m_SvBotSkin);
-		pPlayerInfo->m_Latency = 0;
 	}
+
+	m_ClientInfoValid = true;
+	m_ClientInfoBomb = Bomb;
+}
+
+void CPlayer::SnapSpectatorInfo()  {
+	if(m_Team != TEAM_SPECTATORS)
+		return;
+
+	CNetObj_SpectatorInfo *pSpectatorInfo = static_cast<CNetObj_SpectatorInfo *>(Server()->SnapNewItem(NETOBJTYPE_SPECTATORINFO, m_ClientID, sizeof(CNetObj_SpectatorInfo)));
+	if(!pSpectatorInfo)	return;
+	pSpectatorInfo->m_SpectatorID = m_SpectatorID;
+	pSpectatorInfo->m_X = m_ViewPos.x;
+	pSpectatorInfo->m_Y = m_ViewPos.y;
 }
 
 void CPlayer::OnDisconnect(const char *pReason)
@@ -6,6 +6,7 @@
 // this include should perhaps be removed
 #include "entities/character.h"
 #include "gamecontext.h"
+#include "idmap.h"
 
 // player object
 class CPlayer
@@ -27,6 +28,10 @@ public:
 	void Tick();
 	void PostTick();
 	void Snap(int SnappingClient);
+	void SnapSpectatorInfo();
+
+	// call after the name, clan, country, skin, colors or anonymity changed
+	void InvalidateClientInfo() { m_ClientInfoValid = false; }
 
 	void OnDirectInput(CNetObj_PlayerInput *NewInput);
 	void OnPredictedInput(CNetObj_PlayerInput *NewInput);
@@ -48,6 +53,9 @@ public:
 	// used for spectator mode
 	int m_SpectatorID;
 
+	// the ids of the other players as this client knows them
+	CIDMap m_IDMap;
+
 	bool m_IsReady;
 
 
@@ -143,6 +151,12 @@ private:
 	bool m_Spawning;
 	int m_ClientID;
 	int m_Team;
+
+	// the client info is only encoded again after a change
+	CNetObj_ClientInfo m_ClientInfo;
+	bool m_ClientInfoValid;
+	bool m_ClientInfoBomb;
+	void UpdateClientInfo(bool Bomb);
 };
 
 #endif
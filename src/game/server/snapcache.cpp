@@ -0,0 +1,296 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/server.h>
+#include <game/generated/protocol.h>
+
+#include "gamecontext.h"
+#include "snapcache.h"
+
+CSnapCache::CSnapCache()
+{
+	m_pGameServer = 0;
+	m_NumItems = 0;
+	m_DataSize = 0;
+	m_SnappingClient = -1;
+	m_Building = false;
+	m_Valid = false;
+	m_Overflow = false;
+	m_LastOverflow = false;
+
+	m_pViewCells = 0;
+	m_pEventCells = 0;
+	m_NumCells = 0;
+}
+
+CSnapCache::~CSnapCache()
+{
+	if(m_pViewCells)
+		mem_free(m_pViewCells);
+	if(m_pEventCells)
+		mem_free(m_pEventCells);
+}
+
+void CSnapCache::SetGameServer(CGameContext *pGameServer)
+{
+	m_pGameServer = pGameServer;
+}
+
+void CSnapCache::Begin(int SnappingClient)
+{
+	m_NumItems = 0;
+	m_DataSize = 0;
+	m_SnappingClient = SnappingClient;
+	m_Building = true;
+	m_Valid = false;
+	m_Overflow = false;
+
+	GameServer()->Server()->SnapClearItems();
+	m_GroupClip = CLIP_NONE;
+	m_GroupOwner = -1;
+	m_GroupPatchLatency = false;
+}
+
+void CSnapCache::End()
+{
+	EndGroup();
+	m_Building = false;
+
+	if(m_Overflow && m_SnappingClient == -1)
+	{
+		if(!m_LastOverflow)
+			dbg_msg("snapcache", "the world doesn't fit into the shared snapshot, snapping per client");
+		m_LastOverflow = true;
+		return;
+	}
+
+	BuildCells();
+	if(m_SnappingClient == -1)
+		m_LastOverflow = false;
+	m_Valid = true;
+}
+
+void CSnapCache::BuildCells()
+{
+	CGameWorld *pWorld = &GameServer()->m_World;
+	int NumCells = pWorld->GridWidth()*pWorld->GridHeight();
+	if(NumCells != m_NumCells)
+	{
+		if(m_pViewCells)
+			mem_free(m_pViewCells);
+		if(m_pEventCells)
+			mem_free(m_pEventCells);
+		m_pViewCells = (int *)mem_alloc(NumCells*sizeof(int), 1);
+		m_pEventCells = (int *)mem_alloc(NumCells*sizeof(int), 1);
+		m_NumCells = NumCells;
+	}
+
+	// reset the cells
+	for(int i = 0; i < m_NumCells; i++)
+	{
+		m_pViewCells[i] = -1;
+		m_pEventCells[i] = -1;
+	}
+	mem_zero(m_aAlwaysVisible, sizeof(m_aAlwaysVisible));
+
+	// insert backwards, so the lists are in item order
+	for(int i = m_NumItems-1; i >= 0; i--)
+	{
+		const CItem *pItem = &m_aItems[i];
+		if(pItem->m_Clip == CLIP_NONE)
+		{
+			m_aAlwaysVisible[i/32] |= 1u<<(i%32);
+			continue;
+		}
+
+		int *pCells = pItem->m_Clip == CLIP_VIEW ? m_pViewCells : m_pEventCells;
+		int Cell = pWorld->GridCoord(pItem->m_ClipPos.y, pWorld->GridHeight())*pWorld->GridWidth() + pWorld->GridCoord(pItem->m_ClipPos.x, pWorld->GridWidth());
+		m_aNextInCell[i] = pCells[Cell];
+		pCells[Cell] = i;
+	}
+}
+
+void CSnapCache::MarkCells(const int *pCells, vec2 Pos, float RangeX, float RangeY, unsigned *pVisible)
+{
+	CGameWorld *pWorld = &GameServer()->m_World;
+	int x0 = pWorld->GridCoord(Pos.x-RangeX, pWorld->GridWidth());
+	int y0 = pWorld->GridCoord(Pos.y-RangeY, pWorld->GridHeight());
+	int x1 = pWorld->GridCoord(Pos.x+RangeX, pWorld->GridWidth());
+	int y1 = pWorld->GridCoord(Pos.y+RangeY, pWorld->GridHeight());
+
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(int i = pCells[y*pWorld->GridWidth()+x]; i != -1; i = m_aNextInCell[i])
+				pVisible[i/32] |= 1u<<(i%32);
+}
+
+void CSnapCache::BeginGroup(int Owner, bool PatchLatency)
+{
+	if(!m_Building)
+		return;
+
+	EndGroup();
+	m_GroupClip = CLIP_NONE;
+	m_GroupOwner = Owner;
+	m_GroupPatchLatency = PatchLatency;
+}
+
+void CSnapCache::ClipView(vec2 Pos)
+{
+	if(!m_Building)
+		return;
+
+	m_GroupClip = CLIP_VIEW;
+	m_GroupClipPos = Pos;
+}
+
+void CSnapCache::ClipEvent(vec2 Pos, const CClientMask &Mask)
+{
+	if(!m_Building)
+		return;
+
+	m_GroupClip = CLIP_EVENT;
+	m_GroupClipPos = Pos;
+	m_GroupClipMask = Mask;
+}
+
+void CSnapCache::EndGroup()
+{
+	// the items are complete once their snap function returned, move them over
+	int NumItems = GameServer()->Server()->SnapNumItems();
+	for(int i = 0; i < NumItems && !m_Overflow; i++)
+	{
+		int Type, ID, Size;
+		const void *pData = GameServer()->Server()->SnapGetItem(i, &Type, &ID, &Size);
+		if(m_NumItems == MAX_ITEMS || m_DataSize+Size > MAX_DATASIZE)
+		{
+			m_Overflow = true;
+			break;
+		}
+
+		CItem *pItem = &m_aItems[m_NumItems++];
+		pItem->m_Type = Type;
+		pItem->m_ID = ID;
+		pItem->m_Size = Size;
+		pItem->m_Offset = m_DataSize;
+		pItem->m_Clip = m_GroupClip;
+		pItem->m_ClipPos = m_GroupClipPos;
+		pItem->m_ClipMask = m_GroupClipMask;
+		pItem->m_Owner = m_GroupOwner;
+		pItem->m_PatchLatency = m_GroupPatchLatency;
+		mem_copy(&m_aData[m_DataSize], pData, Size);
+		m_DataSize += Size;
+	}
+	GameServer()->Server()->SnapClearItems();
+}
+
+bool CSnapCache::Clipped(const CItem *pItem, int SnappingClient)
+{
+	if(pItem->m_Clip == CLIP_VIEW)
+		return GameServer()->NetworkClipped(SnappingClient, pItem->m_ClipPos);
+	if(pItem->m_Clip == CLIP_EVENT)
+		return !CmaskIsSet(pItem->m_ClipMask, SnappingClient) ||
+			distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, pItem->m_ClipPos) >= EVENT_RANGE;
+	return false;
+}
+
+void CSnapCache::SnapItem(const CItem *pItem, int SnappingClient, CPlayer *pSnappingPlayer)
+{
+	// the items of players without an id on the client are left out
+	const CIDMap *pIDMap = pSnappingPlayer && !pSnappingPlayer->m_IDMap.Identity() ? &pSnappingPlayer->m_IDMap : 0;
+	int ID = pItem->m_ID;
+	if(pIDMap)
+	{
+		switch(pItem->m_Type)
+		{
+		case NETOBJTYPE_CLIENTINFO:
+		case NETOBJTYPE_PLAYERINFO:
+		case NETOBJTYPE_CHARACTER:
+		case NETOBJTYPE_SPECTATORINFO:
+		case 32764: // DDNetCharacter, see CCharacter::Snap
+			ID = pIDMap->ToLocal(ID);
+			if(ID == -1)
+				return;
+			break;
+		case NETEVENTTYPE_DEATH:
+			if(pIDMap->ToLocal(((const CNetEvent_Death *)&m_aData[pItem->m_Offset])->m_ClientID) == -1)
+				return;
+			break;
+		}
+	}
+
+	void *pData = GameServer()->Server()->SnapNewItem(pItem->m_Type, ID, pItem->m_Size);
+	if(!pData)
+		return;
+	mem_copy(pData, &m_aData[pItem->m_Offset], pItem->m_Size);
+
+	if(pIDMap)
+	{
+		if(pItem->m_Type == NETOBJTYPE_PLAYERINFO)
+			((CNetObj_PlayerInfo *)pData)->m_ClientID = ID;
+		else if(pItem->m_Type == NETOBJTYPE_CHARACTER)
+		{
+			CNetObj_Character *pCharacter = (CNetObj_Character *)pData;
+			pCharacter->m_HookedPlayer = pIDMap->ToLocal(pCharacter->m_HookedPlayer);
+		}
+		else if(pItem->m_Type == NETOBJTYPE_SPECTATORINFO)
+		{
+			CNetObj_SpectatorInfo *pSpectatorInfo = (CNetObj_SpectatorInfo *)pData;
+			pSpectatorInfo->m_SpectatorID = pIDMap->ToLocal(pSpectatorInfo->m_SpectatorID);
+		}
+		else if(pItem->m_Type == NETEVENTTYPE_DEATH)
+		{
+			CNetEvent_Death *pDeath = (CNetEvent_Death *)pData;
+			pDeath->m_ClientID = pIDMap->ToLocal(pDeath->m_ClientID);
+		}
+	}
+
+	// the cached player infos are the ones for SnappingClient -1
+	if(m_SnappingClient != -1 || pItem->m_Type != NETOBJTYPE_PLAYERINFO || pItem->m_Owner < 0 || !pSnappingPlayer)
+		return;
+
+	CNetObj_PlayerInfo *pPlayerInfo = (CNetObj_PlayerInfo *)pData;
+	pPlayerInfo->m_Local = pItem->m_Owner == SnappingClient ? 1 : 0;
+	if(pItem->m_PatchLatency)
+		pPlayerInfo->m_Latency = pSnappingPlayer->m_aActLatency[pItem->m_Owner];
+	if(pItem->m_Owner == SnappingClient)
+		pSnappingPlayer->SnapSpectatorInfo();
+}
+
+void CSnapCache::Snap(int SnappingClient)
+{
+	CPlayer *pSnappingPlayer = SnappingClient != -1 ? GameServer()->m_apPlayers[SnappingClient] : 0;
+
+	// spectators see the whole world, so they check every item
+	vec2 ViewPos = pSnappingPlayer ? pSnappingPlayer->m_ViewPos : vec2(0, 0);
+	if(!pSnappingPlayer || pSnappingPlayer->GetTeam() == TEAM_SPECTATORS || ViewPos.x != ViewPos.x || ViewPos.y != ViewPos.y)
+	{
+		for(int i = 0; i < m_NumItems; i++)
+		{
+			const CItem *pItem = &m_aItems[i];
+			if(SnappingClient != -1 && Clipped(pItem, SnappingClient))
+				continue;
+			SnapItem(pItem, SnappingClient, pSnappingPlayer);
+		}
+		return;
+	}
+
+	// only the items in the cells around the view are candidates
+	unsigned aVisible[MAX_ITEMS/32];
+	mem_copy(aVisible, m_aAlwaysVisible, sizeof(aVisible));
+	MarkCells(m_pViewCells, ViewPos, VIEW_RANGE_X+1, VIEW_RANGE_Y+1, aVisible);
+	MarkCells(m_pEventCells, ViewPos, EVENT_RANGE+1, EVENT_RANGE+1, aVisible);
+
+	for(int w = 0; w < MAX_ITEMS/32; w++)
+	{
+		unsigned Bits = aVisible[w];
+		for(int i = w*32; Bits; i++, Bits >>= 1)
+		{
+			if(!(Bits&1))
+				continue;
+
+			const CItem *pItem = &m_aItems[i];
+			if(!Clipped(pItem, SnappingClient))
+				SnapItem(pItem, SnappingClient, pSnappingPlayer);
+		}
+	}
+}
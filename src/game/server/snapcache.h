@@ -0,0 +1,115 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_SNAPCACHE_H
+#define GAME_SERVER_SNAPCACHE_H
+
+#include <base/vmath.h>
+
+#include "clientmask.h"
+
+/*
+	Class: CSnapCache
+		Holds the client independent snapshot items of the current tick.
+		The world, controller, events and players are snapped once for
+		SnappingClient -1, each client snapshot is then made by filtering
+		these items by visibility and patching the few per client fields.
+		The clipped items are bucketed into the world grid, so a client
+		only checks the items in the cells around its view.
+		The player ids are translated for the clients that know fewer
+		ids than there are slots, see CIDMap.
+		The snapshot builder of the server only holds the items of the
+		current group, they are moved into the cache once the group is
+		done. If the world doesn't fit into the cache either, it stays
+		invalid and the clients are snapped one by one for that tick.
+		The clients that need their ids translated then get a cache of
+		their own view, built for their SnappingClient.
+*/
+class CSnapCache
+{
+	// the whole world with all slots in use, before clipping
+	static const int MAX_ITEMS = 2048;
+	static const int MAX_DATASIZE = 128*1024;
+
+	// must cover the ranges of CGameContext::NetworkClipped and CEventHandler::Snap
+	static const int VIEW_RANGE_X = 1000;
+	static const int VIEW_RANGE_Y = 800;
+	static const int EVENT_RANGE = 1500;
+
+	enum
+	{
+		CLIP_NONE=0,
+		CLIP_VIEW,
+		CLIP_EVENT,
+	};
+
+	struct CItem
+	{
+		int m_Type;
+		int m_ID;
+		int m_Size;
+		int m_Offset;
+
+		int m_Clip;
+		vec2 m_ClipPos;
+		CClientMask m_ClipMask;
+		int m_Owner;
+		bool m_PatchLatency;
+	};
+
+	CItem m_aItems[MAX_ITEMS];
+	char m_aData[MAX_DATASIZE];
+	int m_NumItems;
+	int m_DataSize;
+
+	// the clipped items bucketed into the world grid cells, as linked
+	// lists of item indices. the other items are always visible
+	int *m_pViewCells;
+	int *m_pEventCells;
+	int m_NumCells;
+	int m_aNextInCell[MAX_ITEMS];
+	unsigned m_aAlwaysVisible[MAX_ITEMS/32];
+
+	// state of the items snapped since the last BeginGroup
+	int m_GroupClip;
+	vec2 m_GroupClipPos;
+	CClientMask m_GroupClipMask;
+	int m_GroupOwner;
+	bool m_GroupPatchLatency;
+
+	// -1 for the shared snapshot
+	int m_SnappingClient;
+	bool m_Building;
+	bool m_Valid;
+	bool m_Overflow;
+	bool m_LastOverflow;
+
+	class CGameContext *m_pGameServer;
+
+	void EndGroup();
+	void BuildCells();
+	void MarkCells(const int *pCells, vec2 Pos, float RangeX, float RangeY, unsigned *pVisible);
+	bool Clipped(const CItem *pItem, int SnappingClient);
+	void SnapItem(const CItem *pItem, int SnappingClient, class CPlayer *pSnappingPlayer);
+
+public:
+	CGameContext *GameServer() const { return m_pGameServer; }
+	void SetGameServer(CGameContext *pGameServer);
+
+	CSnapCache();
+	~CSnapCache();
+
+	void Begin(int SnappingClient = -1);
+	void End();
+	void Snap(int SnappingClient);
+	void Invalidate() { m_Valid = false; }
+	bool Valid() const { return m_Valid; }
+	int NumItems() const { return m_NumItems; }
+
+	// used by the snap functions while the cache is built
+	bool Building() const { return m_Building; }
+	void BeginGroup(int Owner = -1, bool PatchLatency = false);
+	void ClipView(vec2 Pos);
+	void ClipEvent(vec2 Pos, const CClientMask &Mask);
+};
+
+#endif
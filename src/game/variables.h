@@ -34,6 +34,9 @@ MACRO_CONFIG_INT(SvVoteKick, sv_vote_kick, 1, 0, 1, CFGFLAG_SERVER, "Allow votin
 MACRO_CONFIG_INT(SvVoteKickMin, sv_vote_kick_min, 0, 0, MAX_CLIENTS, CFGFLAG_SERVER, "Minimum number of players required to start a kick vote")
 MACRO_CONFIG_INT(SvVoteKickBantime, sv_vote_kick_bantime, 5, 0, 1440, CFGFLAG_SERVER, "The time to ban a player if kicked by vote. 0 makes it just use kick")
 // debug
+MACRO_CONFIG_INT(DbgMoveTrace, dbg_move_trace, 0, 0, 1, CFGFLAG_SERVER, "Record the last character moves for collision_bench")
+MACRO_CONFIG_INT(DbgWorldGrid, dbg_world_grid, 0, 0, 1, CFGFLAG_SERVER, "Check the world grid queries against a full search")
+MACRO_CONFIG_INT(DbgCoreBroadphase, dbg_core_broadphase, 0, 0, 1, CFGFLAG_SERVER, "Check the character broadphase queries against all characters")
 #ifdef CONF_DEBUG // this one can crash the server if not used correctly
 	MACRO_CONFIG_INT(DbgDummies, dbg_dummies, 0, 0, 15, CFGFLAG_SERVER, "")
 #endif